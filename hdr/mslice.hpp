@@ -36,13 +36,41 @@
 #include <memory>
 #include <tuple>
 #include <stdexcept>
+#include <string>
 #include <type_traits>
+#include <utility>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+// std::pmr adapter of the node arenas, C++17 only
+//
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define MSLICE_HAS_PMR
+#endif
+#endif
 
 #include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
 
-#ifdef MSLICE_USE_MMAP
 #include <sys/mman.h>
-#endif
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace mem {
 
@@ -54,6 +82,95 @@ namespace mem {
         const std::tuple<> none{};
     }
 
+    // layer specifications: wrappers of a layer type that change how the
+    // slice manager lays out the layer. Slices expose pointers to the
+    // wrapped type.
+    //
+
+    // layer of T whose first element is aligned to A bytes (at least
+    // alignof(T)); elements are aligned individually when sizeof(T) is a
+    // multiple of A.
+    //
+
+    template <typename T, size_t A>
+    struct aligned;
+
+    template <typename T>
+    using cache_aligned = aligned<T, 64>;
+
+    // layer of T whose objects are not constructed at allocation, unless
+    // a non-empty pack is given: they are constructed on demand with
+    // mem::emplace<>() and the slice manager keeps track of the ones that
+    // exist.
+    //
+
+    template <typename T>
+    struct lazy;
+
+    // construction policies: layer of T whose objects, when allocated with
+    // an empty pack, are default-initialized (no zeroing of trivial types)
+    // or copied from the prototype installed in the allocator (for
+    // trivially copyable types).
+    //
+
+    template <typename T>
+    struct uninitialized;
+
+    template <typename T>
+    struct prototyped;
+
+    // layer of variable-length byte regions: the slot holds a byte_region
+    // that refers to bytes carved out of a secondary region of the slice
+    // manager, and released with it. The pack is (len) or (src, len) to
+    // copy len bytes from src; an empty pack gives an empty region. The
+    // capacity reserved is len rounded up to 16 bytes or, with size
+    // classes (in ascending order), to the smallest class that holds it.
+    //
+
+    template <size_t ...Classes>
+    struct bytes;
+
+    typedef bytes<128, 512, 2048, 9216> packet_bytes;
+
+    struct byte_region
+    {
+        byte_region()
+        : data_(nullptr)
+        , size_(0)
+        , capacity_(0)
+        {}
+
+        byte_region(uint8_t *data, size_t size, size_t capacity)
+        : data_(data)
+        , size_(static_cast<uint32_t>(size))
+        , capacity_(static_cast<uint32_t>(capacity))
+        {}
+
+        uint8_t *data() const  { return data_; }
+        uint8_t *begin() const { return data_; }
+        uint8_t *end() const   { return data_ + size_; }
+
+        size_t size() const     { return size_; }
+        size_t capacity() const { return capacity_; }
+        bool   empty() const    { return size_ == 0; }
+
+        // the region can grow in place up to its capacity
+        //
+
+        void
+        resize(size_t n)
+        {
+            if (n > capacity_)
+                throw std::runtime_error("byte_region::resize: beyond capacity");
+            size_ = static_cast<uint32_t>(n);
+        }
+
+    private:
+        uint8_t *data_;
+        uint32_t size_;
+        uint32_t capacity_;
+    };
+
 
     namespace details
     {
@@ -95,90 +212,559 @@ namespace mem {
         };
 
 
+        // layer traits: the type stored in a layer and the alignment
+        // of the layer
+        //
+
+        enum init_kind : int { init_value, init_default, init_prototype };
+
+        template <typename T>
+        struct layer_traits
+        {
+            typedef T type;
+            enum : size_t { alignment = alignof(T) };
+            enum : bool { lazy = false };
+            enum : int { init = init_value };
+            enum : bool { region = false };
+        };
+
+        template <typename T>
+        struct layer_traits<lazy<T>> : layer_traits<T>
+        {
+            static_assert(!layer_traits<T>::region, "mem::lazy: byte regions cannot be lazy");
+
+            enum : bool { lazy = true };
+        };
+
+        template <typename T>
+        struct layer_traits<uninitialized<T>> : layer_traits<T>
+        {
+            enum : int { init = init_default };
+        };
+
+        template <typename T>
+        struct layer_traits<prototyped<T>> : layer_traits<T>
+        {
+            static_assert(std::is_trivially_copyable<typename layer_traits<T>::type>::value,
+                          "mem::prototyped: the layer type must be trivially copyable");
+
+            enum : int { init = init_prototype };
+        };
+
+        template <typename T, size_t A>
+        struct layer_traits<aligned<T, A>> : layer_traits<T>
+        {
+            static_assert((A & (A - 1)) == 0, "mem::aligned: alignment must be a power of 2");
+
+            enum : size_t { alignment = A > layer_traits<T>::alignment ? A : layer_traits<T>::alignment };
+        };
+
+        // capacity reserved for a byte region of len bytes
+        //
+
+        template <size_t ...Cs>
+        struct size_class
+        {
+            static size_t
+            round(size_t len)
+            {
+                return (len + 15) & ~size_t(15);
+            }
+        };
+
+        template <size_t C, size_t C1, size_t ...Cs>
+        struct size_class<C, C1, Cs...>
+        {
+            static_assert(C < C1, "mem::bytes: size classes must be in ascending order");
+
+            static size_t
+            round(size_t len)
+            {
+                return len <= C ? C : size_class<C1, Cs...>::round(len);
+            }
+        };
+
+        template <size_t C>
+        struct size_class<C>
+        {
+            static size_t
+            round(size_t len)
+            {
+                if (len > C)
+                    throw std::runtime_error("mem::bytes: region larger than the largest size class");
+                return C;
+            }
+        };
+
+        template <size_t ...Cs>
+        struct layer_traits<bytes<Cs...>>
+        {
+            typedef byte_region type;
+            enum : size_t { alignment = alignof(byte_region) };
+            enum : bool { lazy = false };
+            enum : int { init = init_value };
+            enum : bool { region = true };
+
+            static size_t
+            round(size_t len)
+            {
+                return size_class<Cs...>::round(len);
+            }
+        };
+
+        template <typename T>
+        using layer_type = typename layer_traits<T>::type;
+
+        template <size_t N, typename ...Ts>
+        using layer_traits_at = layer_traits<typename std::tuple_element<N, std::tuple<Ts...>>::type>;
+
+        template <typename ...Ts>
+        struct any_lazy : std::false_type { };
+
+        template <typename T, typename ...Ts>
+        struct any_lazy<T, Ts...> : std::integral_constant<bool, layer_traits<T>::lazy || any_lazy<Ts...>::value> { };
+
+        template <typename ...Ts>
+        struct any_region : std::false_type { };
+
+        template <typename T, typename ...Ts>
+        struct any_region<T, Ts...> : std::integral_constant<bool, layer_traits<T>::region || any_region<Ts...>::value> { };
+
+        // presence of the lazy layers of a slot: bit N is set when the
+        // object of the layer N exists
+        //
+
+        typedef uint32_t presence_type;
+
+        // slices with lazy layers refer to the presence mask of their slot
+        //
+
+        template <bool Lazy>
+        struct slice_presence
+        {
+        };
+
+        template <>
+        struct slice_presence<true>
+        {
+            slice_presence()
+            : presence_(nullptr)
+            {}
+
+            presence_type *presence_;
+        };
+
+        inline void
+        bind_presence(slice_presence<false> &, presence_type *)
+        {
+        }
+
+        inline void
+        bind_presence(slice_presence<true> &s, presence_type *mask)
+        {
+            s.presence_ = mask;
+        }
+
+        constexpr inline
+        size_t align_up(size_t n, size_t align)
+        {
+            return (n + align - 1) / align * align;
+        }
+
+        // layout of the layers of M elements in the memory of a manager:
+        // layers are stored in order, each one at an offset aligned as
+        // required by its layer traits.
+        //
+
+        template <typename ...Ts>
+        struct layout
+        {
+            static constexpr size_t size(size_t, size_t off = 0)
+            {
+                return off;
+            }
+
+            static constexpr size_t offset(size_t, size_t, size_t off = 0)
+            {
+                return off;
+            }
+
+            static constexpr size_t alignment()
+            {
+                return 1;
+            }
+        };
+
+        template <typename T, typename ...Ts>
+        struct layout<T, Ts...>
+        {
+            static constexpr size_t begin(size_t off)
+            {
+                return align_up(off, layer_traits<T>::alignment);
+            }
+
+            static constexpr size_t end(size_t m, size_t off)
+            {
+                return begin(off) + sizeof(layer_type<T>) * m;
+            }
+
+            // total size of the layers, starting at offset off
+            //
+
+            static constexpr size_t size(size_t m, size_t off = 0)
+            {
+                return layout<Ts...>::size(m, end(m, off));
+            }
+
+            // offset of the n-th layer
+            //
+
+            static constexpr size_t offset(size_t n, size_t m, size_t off = 0)
+            {
+                return n == 0 ? begin(off) : layout<Ts...>::offset(n - 1, m, end(m, off));
+            }
+
+            // alignment required for the memory of the layers
+            //
+
+            static constexpr size_t alignment()
+            {
+                return layer_traits<T>::alignment > layout<Ts...>::alignment() ?
+                       layer_traits<T>::alignment : layout<Ts...>::alignment();
+            }
+        };
+
+
         // allocate, construct and destroy...
         //
 
-        template <size_t M, typename Tp>
+        template <typename Layout, typename Tp>
         static inline
-        void allocate(Tp &t, char *mem, std::integral_constant<size_t,0>)
+        void allocate(Tp &t, char *mem, size_t m, std::integral_constant<size_t,0>)
         {
             typedef typename
             std::remove_pointer<
                 typename std::tuple_element<0, Tp>::type>::type current_type;
 
-            std::get<0>(t) = reinterpret_cast<current_type *>(mem);
+            std::get<0>(t) = reinterpret_cast<current_type *>(mem + Layout::offset(0, m));
         }
-        template <size_t M, size_t N, typename Tp>
+        template <typename Layout, size_t N, typename Tp>
         static inline
-        void allocate(Tp &t, char *mem, std::integral_constant<size_t, N>)
+        void allocate(Tp &t, char *mem, size_t m, std::integral_constant<size_t, N>)
         {
             typedef typename
             std::remove_pointer<
                 typename std::tuple_element<N, Tp>::type>::type current_type;
 
-            std::get<N>(t) = reinterpret_cast<current_type *>(mem);
-            allocate<M>(t, mem + sizeof(current_type) * M, std::integral_constant<size_t, N-1>());
+            std::get<N>(t) = reinterpret_cast<current_type *>(mem + Layout::offset(N, m));
+            allocate<Layout>(t, mem, m, std::integral_constant<size_t, N-1>());
         }
 
-        template <typename Tp>
+        // destroy the objects of the slots [b, e) of a layer: for lazy
+        // layers, only the ones that exist. Trivially destructible layers
+        // are skipped.
+        //
+
+        template <typename T>
         static inline
-        void destroy(Tp &t, size_t s, std::integral_constant<size_t, 0>)
+        void destroy_objects(T *p, size_t b, size_t e, presence_type const *, unsigned, std::false_type)
         {
-            typedef typename
-            std::remove_pointer<
-                typename std::tuple_element<0, Tp>::type>::type current_type;
+            for(size_t i=b; i < e; i++)
+                (p+i)->~T();
+        }
+
+        template <typename T>
+        static inline
+        void destroy_objects(T *p, size_t b, size_t e, presence_type const *mask, unsigned bit, std::true_type)
+        {
+            for(size_t i=b; i < e; i++)
+                if ((mask[i] >> bit) & 1)
+                    (p+i)->~T();
+        }
 
-            for(size_t i=0; i < s; i++)
-                (std::get<0>(t)+i)->~current_type();
+        template <typename T, typename Lazy>
+        static inline
+        void destroy_layer(T *p, size_t b, size_t e, presence_type const *mask, unsigned bit, Lazy lazy)
+        {
+            if (!std::is_trivially_destructible<T>::value)
+                destroy_objects(p, b, e, mask, bit, lazy);
         }
-        template <size_t N, typename Tp>
+
+        template <typename Specs, typename Tp>
         static inline
-        void destroy(Tp &t, size_t s, std::integral_constant<size_t,N>)
+        void destroy(Tp &t, size_t b, size_t e, presence_type const *mask, std::integral_constant<size_t, 0>)
         {
-            typedef typename
-            std::remove_pointer<
-                typename std::tuple_element<N, Tp>::type>::type current_type;
+            destroy_layer(std::get<0>(t), b, e, mask, 0,
+                          std::integral_constant<bool, layer_traits<typename std::tuple_element<0, Specs>::type>::lazy>());
+        }
+        template <typename Specs, size_t N, typename Tp>
+        static inline
+        void destroy(Tp &t, size_t b, size_t e, presence_type const *mask, std::integral_constant<size_t,N>)
+        {
+            destroy_layer(std::get<N>(t), b, e, mask, N,
+                          std::integral_constant<bool, layer_traits<typename std::tuple_element<N, Specs>::type>::lazy>());
+
+            destroy<Specs>(t, b, e, mask, std::integral_constant<size_t, N-1>());
+        }
+
+        // initialize the object of a layer allocated with an empty pack,
+        // according to its construction policy. Prototyped layers without
+        // a prototype are value-initialized.
+        //
+
+        template <typename T>
+        static inline
+        void init_object(T *ptr, T const *, std::integral_constant<int, init_value>)
+        {
+            new (ptr) T();
+        }
+
+        template <typename T>
+        static inline
+        void init_object(T *ptr, T const *, std::integral_constant<int, init_default>)
+        {
+            new (ptr) T;
+        }
+
+        template <typename T>
+        static inline
+        void init_object(T *ptr, T const *proto, std::integral_constant<int, init_prototype>)
+        {
+            if (proto)
+                std::memcpy(static_cast<void *>(ptr), proto, sizeof(T));
+            else
+                new (ptr) T();
+        }
+
+        // build the object of a layer: lazy layers without arguments are
+        // left unconstructed. Return true if the object has been built.
+        //
 
-            for(size_t i=0; i < s; i++)
-                (std::get<N>(t)+i)->~current_type();
+        template <typename Traits, typename T>
+        static inline
+        bool build(T *ptr, T const *proto)
+        {
+            if (Traits::lazy)
+                return false;
 
-            destroy(t, s, std::integral_constant<size_t, N-1>());
+            init_object(ptr, proto, std::integral_constant<int, Traits::init>());
+            return true;
         }
 
-        template <typename Tp, typename Tuple, int ... S>
+        template <typename Traits, typename T, typename A, typename ...As>
         static inline
-        void construct(Tp &r, Tp const &t, size_t offset, std::integral_constant<size_t, 0>, Tuple && packs, seq<S...>)
+        bool build(T *ptr, T const *, A && arg, As && ...args)
         {
-            typedef typename std::remove_pointer<
-                typename std::tuple_element<0, Tp>::type>::type current_type;
+            new (ptr) T(std::forward<A>(arg), std::forward<As>(args)...);
+            return true;
+        }
+
+        // bump allocator of the secondary region of a slice manager, where
+        // the bytes of the byte regions are carved
+        //
+
+        struct region_cursor
+        {
+            uint8_t *base;
+            size_t   size;
+            size_t   used;
+
+            uint8_t *
+            take(size_t n)
+            {
+                if (n > size - used)
+                    throw std::runtime_error("slice_manager: secondary region overflow");
+
+                auto p = base + used;
+                used += n;
+                return p;
+            }
+        };
+
+        // build the object of a layer, carving the bytes of byte regions
+        //
+
+        template <typename Traits, typename T, typename ...As>
+        static inline
+        bool build_layer(T *ptr, T const *proto, region_cursor *, std::false_type, As && ...args)
+        {
+            return build<Traits>(ptr, proto, std::forward<As>(args)...);
+        }
+
+        template <typename Traits>
+        static inline
+        bool build_layer(byte_region *ptr, byte_region const *, region_cursor *, std::true_type)
+        {
+            new (ptr) byte_region();
+            return true;
+        }
+
+        template <typename Traits, typename N>
+        static inline
+        bool build_layer(byte_region *ptr, byte_region const *, region_cursor *r, std::true_type, N && len)
+        {
+            auto n   = static_cast<size_t>(len);
+            auto cap = Traits::round(n);
+            new (ptr) byte_region(r->take(cap), n, cap);
+            return true;
+        }
+
+        template <typename Traits, typename P, typename N>
+        static inline
+        bool build_layer(byte_region *ptr, byte_region const *, region_cursor *r, std::true_type, P && src, N && len)
+        {
+            auto n   = static_cast<size_t>(len);
+            auto cap = Traits::round(n);
+            new (ptr) byte_region(r->take(cap), n, cap);
+            std::memcpy(ptr->data(), src, n);
+            return true;
+        }
+
+        // bytes of the secondary region required by the packs of a slot
+        //
+
+        template <typename Traits, typename ...As>
+        static inline
+        size_t region_size(std::false_type, std::tuple<As...> const &)
+        {
+            return 0;
+        }
+
+        template <typename Traits>
+        static inline
+        size_t region_size(std::true_type, std::tuple<> const &)
+        {
+            return 0;
+        }
+
+        template <typename Traits, typename N>
+        static inline
+        size_t region_size(std::true_type, std::tuple<N> const &pack)
+        {
+            return Traits::round(static_cast<size_t>(std::get<0>(pack)));
+        }
+
+        template <typename Traits, typename P, typename N>
+        static inline
+        size_t region_size(std::true_type, std::tuple<P, N> const &pack)
+        {
+            return Traits::round(static_cast<size_t>(std::get<1>(pack)));
+        }
+
+        template <typename Specs, typename Tuple>
+        static inline
+        size_t region_request(Tuple const &packs, std::integral_constant<size_t, 0>)
+        {
+            typedef layer_traits<typename std::tuple_element<0, Specs>::type> traits;
+            return region_size<traits>(std::integral_constant<bool, traits::region>(), std::get<0>(packs));
+        }
+        template <typename Specs, size_t N, typename Tuple>
+        static inline
+        size_t region_request(Tuple const &packs, std::integral_constant<size_t, N>)
+        {
+            typedef layer_traits<typename std::tuple_element<N, Specs>::type> traits;
+            return region_size<traits>(std::integral_constant<bool, traits::region>(), std::get<N>(packs)) +
+                   region_request<Specs>(packs, std::integral_constant<size_t, N-1>());
+        }
+
+        template <typename Specs, typename Tp, typename Protos, typename Tuple, int ... S>
+        static inline
+        void construct(Tp &r, Tp const &t, size_t offset, Protos const &protos, presence_type *mask, region_cursor *regions, std::integral_constant<size_t, 0>, Tuple && packs, seq<S...>)
+        {
+            typedef layer_traits<typename std::tuple_element<0, Specs>::type> traits;
             auto ptr = (std::get<0>(t)+offset);
 
-            new (ptr) current_type(std::get<S>(std::get<0>(packs))...);
+            if (build_layer<traits>(ptr, std::get<0>(protos).get(), regions, std::integral_constant<bool, traits::region>(),
+                                    std::get<S>(std::get<0>(packs))...) && traits::lazy)
+                *mask |= 1U;
 
             std::get<0>(r) = ptr;
         }
-        template <size_t N, typename Tp, typename Tuple, int ... S>
+        template <typename Specs, size_t N, typename Tp, typename Protos, typename Tuple, int ... S>
         static inline
-        void construct(Tp &r, Tp const &t, size_t offset, std::integral_constant<size_t, N>, Tuple && packs, seq<S...>)
+        void construct(Tp &r, Tp const &t, size_t offset, Protos const &protos, presence_type *mask, region_cursor *regions, std::integral_constant<size_t, N>, Tuple && packs, seq<S...>)
         {
-            typedef typename std::remove_pointer<
-                typename std::tuple_element<N, Tp>::type>::type current_type;
+            typedef layer_traits<typename std::tuple_element<N, Specs>::type> traits;
             auto ptr = (std::get<N>(t)+offset);
 
-            new (ptr) current_type(std::get<S>(std::get<N>(packs))...);
+            if (build_layer<traits>(ptr, std::get<N>(protos).get(), regions, std::integral_constant<bool, traits::region>(),
+                                    std::get<S>(std::get<N>(packs))...) && traits::lazy)
+                *mask |= 1U << N;
 
             std::get<N>(r) = ptr;
-            construct(r, t, offset, std::integral_constant<size_t, N-1>(), std::forward<Tuple>(packs),
+            construct<Specs>(r, t, offset, protos, mask, regions, std::integral_constant<size_t, N-1>(), std::forward<Tuple>(packs),
                         typename gens<
                             std::tuple_size<
                                 typename std::decay<
-                                    typename std::tuple_element<N-1, Tuple>::type
+                                    typename std::tuple_element<N-1, typename std::decay<Tuple>::type>::type
                                 >::type
                             >::value
                         >::type());
         }
 
 
+        // common base of slice managers: the reference count used by the
+        // non-atomic handles and the hook invoked when the last reference
+        // goes away.
+        //
+
+        struct manager_base
+        {
+            explicit manager_base(void (*dispose)(manager_base *))
+            : refs_(0)
+            , dispose_(dispose)
+            , prev_(nullptr)
+            , next_(nullptr)
+            {}
+
+            void acquire()
+            {
+                refs_++;
+            }
+
+            void release()
+            {
+                if (--refs_ == 0)
+                    dispose_(this);
+            }
+
+            void release(size_t n)
+            {
+                if ((refs_ -= n) == 0)
+                    dispose_(this);
+            }
+
+            // number of handles that refer to the manager
+            //
+
+            size_t handles() const
+            {
+                auto n = owner_.use_count();
+                return n ? static_cast<size_t>(n) : refs_;
+            }
+
+            size_t refs_;
+            void (*dispose_)(manager_base *);
+
+            // links of the list of live managers of an allocator
+            manager_base *prev_;
+            manager_base *next_;
+
+            // control block of the std::shared_ptr owning the manager (shared_refcount)
+            std::weak_ptr<void> owner_;
+        };
+
+        // deleter for std::shared_ptr<> owning a slice manager
+        //
+
+        struct manager_disposer
+        {
+            void operator()(manager_base *m) const
+            {
+                m->dispose_(m);
+            }
+        };
+
     } // namespace details
 
 
@@ -187,9 +773,12 @@ namespace mem {
     //
 
     template <typename ...Ts>
-    struct slice
+    struct slice : details::slice_presence<details::any_lazy<Ts...>::value>
     {
-        typedef std::tuple<typename std::add_pointer<Ts>::type...> tuple_type;
+        static_assert(sizeof...(Ts) <= sizeof(details::presence_type) * 8 || !details::any_lazy<Ts...>::value,
+                      "mem::slice: too many layers for lazy construction");
+
+        typedef std::tuple<typename std::add_pointer<details::layer_type<Ts>>::type...> tuple_type;
 
         tuple_type tuple_;
 
@@ -250,15 +839,15 @@ namespace mem {
     //
 
     template <typename T, typename ...Ts>
-    inline auto get(slice<Ts...> &s) -> decltype(std::get<details::type_index<T, Ts...>::value>(s.tuple_))
+    inline auto get(slice<Ts...> &s) -> decltype(std::get<details::type_index<T, details::layer_type<Ts>...>::value>(s.tuple_))
     {
-        return std::get<details::type_index<T, Ts...>::value>(s.tuple_);
+        return std::get<details::type_index<T, details::layer_type<Ts>...>::value>(s.tuple_);
     }
 
     template <typename T, typename ...Ts>
-    inline auto get(slice<Ts...> const &s) -> decltype(std::get<details::type_index<T, Ts...>::value>(s.tuple_))
+    inline auto get(slice<Ts...> const &s) -> decltype(std::get<details::type_index<T, details::layer_type<Ts>...>::value>(s.tuple_))
     {
-        return std::get<details::type_index<T, Ts...>::value>(s.tuple_);
+        return std::get<details::type_index<T, details::layer_type<Ts>...>::value>(s.tuple_);
     }
 
     // helper function for shared_ptr<slice<Ts...>>:
@@ -278,151 +867,4297 @@ namespace mem {
         return mem::get<T>(*s);
     }
 
-    // recursive functions that calculate the total size of
-    // memory
+    /////////////////////////////////////////////////////////////////////////
+    // local_ptr: copyable handle that aliases a slice manager, with a
+    // non-atomic reference count. All the copies of handles that refer to
+    // the same manager must be released by the same thread.
     //
 
-    template <size_t M>
-    constexpr inline
-    size_t sizeof_mem()
-    {
-        return 0;
-    }
-    template <size_t M, typename T, typename ...Ts>
-    constexpr inline
-    size_t sizeof_mem()
+    template <typename T>
+    struct local_ptr
     {
-        return sizeof(T) * M + sizeof_mem<M, Ts...>();
-    }
-
-    /////////////////////////////////////////////////////////////
-    // slice manager: utility class that manages layers of memory
-    //
+        typedef T element_type;
 
-    template <size_t M, typename ...Ts>
-    struct slice_manager
-    {
-        typedef slice<Ts...> slice_type;
+        local_ptr() noexcept
+        : ptr_(nullptr)
+        , mgr_(nullptr)
+        {}
 
-        slice_manager()
-        : index_(0)
-        , layer_()
-        , slice_(new slice_type[M])
+        local_ptr(details::manager_base *m, T *p) noexcept
+        : ptr_(p)
+        , mgr_(m)
         {
-            mem_ =
-#ifdef MSLICE_USE_MMAP
-
-#ifndef MAP_UNINITIALIZED
-#define MAP_UNINITIALIZED 0x4000000
-#endif
-            mmap(0, sizeof_mem<M, Ts...>(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_UNINITIALIZED , -1, 0);
-#else
-            malloc(sizeof_mem<M, Ts...>());
-#endif
-            if (mem_ == nullptr)
-                throw std::runtime_error("slice_manager: out of memory");
-
-            details::allocate<M>(layer_.tuple_, static_cast<char *>(mem_), std::integral_constant<size_t, sizeof...(Ts)-1>());
+            mgr_->acquire();
         }
 
+        local_ptr(local_ptr const &other) noexcept
+        : ptr_(other.ptr_)
+        , mgr_(other.mgr_)
+        {
+            if (mgr_)
+                mgr_->acquire();
+        }
+
+        local_ptr(local_ptr &&other) noexcept
+        : ptr_(other.ptr_)
+        , mgr_(other.mgr_)
+        {
+            other.ptr_ = nullptr;
+            other.mgr_ = nullptr;
+        }
+
+        local_ptr& operator=(local_ptr other) noexcept
+        {
+            other.swap(*this);
+            return *this;
+        }
+
+        ~local_ptr()
+        {
+            if (mgr_)
+                mgr_->release();
+        }
+
+        void swap(local_ptr &other) noexcept
+        {
+            std::swap(ptr_, other.ptr_);
+            std::swap(mgr_, other.mgr_);
+        }
+
+        void reset() noexcept
+        {
+            local_ptr().swap(*this);
+        }
+
+        // give up the reference without releasing it, and return the
+        // manager it refers to (used by remote_free_queue)
+        //
+
+        details::manager_base *detach() noexcept
+        {
+            auto m = mgr_;
+            ptr_ = nullptr;
+            mgr_ = nullptr;
+            return m;
+        }
+
+        T *get() const noexcept
+        {
+            return ptr_;
+        }
+
+        T &operator*() const noexcept
+        {
+            return *ptr_;
+        }
+
+        T *operator->() const noexcept
+        {
+            return ptr_;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return ptr_ != nullptr;
+        }
+
+    private:
+        T * ptr_;
+        details::manager_base * mgr_;
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+    // local_unique_ptr: move-only handle that aliases a slice manager, with
+    // the same non-atomic reference count of local_ptr.
+    //
+
+    template <typename T>
+    struct local_unique_ptr
+    {
+        typedef T element_type;
+
+        local_unique_ptr() noexcept
+        : ptr_(nullptr)
+        , mgr_(nullptr)
+        {}
+
+        local_unique_ptr(details::manager_base *m, T *p) noexcept
+        : ptr_(p)
+        , mgr_(m)
+        {
+            mgr_->acquire();
+        }
+
+        local_unique_ptr(local_unique_ptr const &) = delete;
+        local_unique_ptr& operator=(local_unique_ptr const &) = delete;
+
+        local_unique_ptr(local_unique_ptr &&other) noexcept
+        : ptr_(other.ptr_)
+        , mgr_(other.mgr_)
+        {
+            other.ptr_ = nullptr;
+            other.mgr_ = nullptr;
+        }
+
+        local_unique_ptr& operator=(local_unique_ptr &&other) noexcept
+        {
+            local_unique_ptr(std::move(other)).swap(*this);
+            return *this;
+        }
+
+        ~local_unique_ptr()
+        {
+            if (mgr_)
+                mgr_->release();
+        }
+
+        void swap(local_unique_ptr &other) noexcept
+        {
+            std::swap(ptr_, other.ptr_);
+            std::swap(mgr_, other.mgr_);
+        }
+
+        void reset() noexcept
+        {
+            local_unique_ptr().swap(*this);
+        }
+
+        // give up the reference without releasing it, and return the
+        // manager it refers to (used by remote_free_queue)
+        //
+
+        details::manager_base *detach() noexcept
+        {
+            auto m = mgr_;
+            ptr_ = nullptr;
+            mgr_ = nullptr;
+            return m;
+        }
+
+        T *get() const noexcept
+        {
+            return ptr_;
+        }
+
+        T &operator*() const noexcept
+        {
+            return *ptr_;
+        }
+
+        T *operator->() const noexcept
+        {
+            return ptr_;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return ptr_ != nullptr;
+        }
+
+    private:
+        T * ptr_;
+        details::manager_base * mgr_;
+    };
+
+    // helper functions for local_ptr<slice<Ts...>> and local_unique_ptr<slice<Ts...>>:
+    //
+
+    template <size_t N, typename ...Ts>
+    inline auto get(local_ptr<slice<Ts...>> &s)
+    -> decltype(mem::get<N>(*s))
+    {
+        return mem::get<N>(*s);
+    }
+
+    template <typename T, typename ...Ts>
+    inline auto get(local_ptr<slice<Ts...>> &s)
+    -> decltype(mem::get<T>(*s))
+    {
+        return mem::get<T>(*s);
+    }
+
+    template <size_t N, typename ...Ts>
+    inline auto get(local_unique_ptr<slice<Ts...>> &s)
+    -> decltype(mem::get<N>(*s))
+    {
+        return mem::get<N>(*s);
+    }
+
+    template <typename T, typename ...Ts>
+    inline auto get(local_unique_ptr<slice<Ts...>> &s)
+    -> decltype(mem::get<T>(*s))
+    {
+        return mem::get<T>(*s);
+    }
+
+    // lazy layers: construct the object of the layer N (or of type T) of
+    // a slice, replacing the existing one if any.
+    //
+
+    namespace details
+    {
+        template <typename T, typename ...As>
+        inline T *
+        emplace_object(T *ptr, presence_type &mask, unsigned n, As && ...args)
+        {
+            auto bit = presence_type(1) << n;
+
+            if (mask & bit) {
+                mask &= ~bit;
+                ptr->~T();
+            }
+
+            new (ptr) T(std::forward<As>(args)...);
+
+            mask |= bit;
+            return ptr;
+        }
+    }
+
+    template <size_t N, typename ...Ts, typename ...As>
+    inline typename details::layer_traits_at<N, Ts...>::type *
+    emplace(slice<Ts...> &s, As && ...args)
+    {
+        typedef details::layer_traits_at<N, Ts...> traits;
+
+        static_assert(traits::lazy, "mem::emplace: the layer is not lazy");
+
+        return details::emplace_object(mem::get<N>(s), *s.presence_, N, std::forward<As>(args)...);
+    }
+
+    template <typename T, typename ...Ts, typename ...As>
+    inline auto emplace(slice<Ts...> &s, As && ...args)
+    -> decltype(mem::emplace<details::type_index<T, details::layer_type<Ts>...>::value>(s, std::forward<As>(args)...))
+    {
+        return mem::emplace<details::type_index<T, details::layer_type<Ts>...>::value>(s, std::forward<As>(args)...);
+    }
+
+    // true if the object of the layer N (or of type T) of a slice exists:
+    // always true for layers that are not lazy.
+    //
+
+    namespace details
+    {
+        template <size_t N, typename Sp>
+        inline bool has_layer(Sp const &, std::false_type)
+        {
+            return true;
+        }
+
+        template <size_t N, typename Sp>
+        inline bool has_layer(Sp const &s, std::true_type)
+        {
+            return (*s.presence_ >> N) & 1;
+        }
+    }
+
+    template <size_t N, typename ...Ts>
+    inline bool has(slice<Ts...> const &s)
+    {
+        return details::has_layer<N>(s, std::integral_constant<bool, details::layer_traits_at<N, Ts...>::lazy>());
+    }
+
+    template <typename T, typename ...Ts>
+    inline bool has(slice<Ts...> const &s)
+    {
+        return mem::has<details::type_index<T, details::layer_type<Ts>...>::value>(s);
+    }
+
+    // emplace and has for handles (std::shared_ptr, local_ptr...) to slices:
+    //
+
+    template <size_t N, typename Ptr, typename ...As>
+    inline auto emplace(Ptr &p, As && ...args) -> decltype(mem::emplace<N>(*p, std::forward<As>(args)...))
+    {
+        return mem::emplace<N>(*p, std::forward<As>(args)...);
+    }
+
+    template <typename T, typename Ptr, typename ...As>
+    inline auto emplace(Ptr &p, As && ...args) -> decltype(mem::emplace<T>(*p, std::forward<As>(args)...))
+    {
+        return mem::emplace<T>(*p, std::forward<As>(args)...);
+    }
+
+    template <size_t N, typename Ptr>
+    inline auto has(Ptr const &p) -> decltype(mem::has<N>(*p))
+    {
+        return mem::has<N>(*p);
+    }
+
+    template <typename T, typename Ptr>
+    inline auto has(Ptr const &p) -> decltype(mem::has<T>(*p))
+    {
+        return mem::has<T>(*p);
+    }
+
+    /////////////////////////////////////////////////////////////////////////
+    // slice_ref: compact handle to a slice, made of the manager and the
+    // 32-bit index of the slot. The addresses of the objects are computed
+    // from the layers of the manager, which is kept alive by the same
+    // non-atomic reference count of local_ptr (single-thread).
+    //
+    // With slot recycling (allocator_options::recycle) the handle also
+    // carries the generation of the slot, which changes when the slot is
+    // recycled: the copies left behind are stale (see mem::valid).
+    //
+
+    template <typename Manager>
+    struct slice_ref
+    {
+        typedef Manager manager_type;
+
+        slice_ref() noexcept
+        : mgr_(nullptr)
+        , index_(0)
+        , gen_(0)
+        {}
+
+        slice_ref(Manager *m, uint32_t index, uint32_t generation = 0) noexcept
+        : mgr_(m)
+        , index_(index)
+        , gen_(generation)
+        {
+            mgr_->acquire();
+        }
+
+        slice_ref(slice_ref const &other) noexcept
+        : mgr_(other.mgr_)
+        , index_(other.index_)
+        , gen_(other.gen_)
+        {
+            if (mgr_)
+                mgr_->acquire();
+        }
+
+        slice_ref(slice_ref &&other) noexcept
+        : mgr_(other.mgr_)
+        , index_(other.index_)
+        , gen_(other.gen_)
+        {
+            other.mgr_ = nullptr;
+        }
+
+        slice_ref& operator=(slice_ref other) noexcept
+        {
+            other.swap(*this);
+            return *this;
+        }
+
+        ~slice_ref()
+        {
+            if (mgr_)
+                mgr_->release();
+        }
+
+        void swap(slice_ref &other) noexcept
+        {
+            std::swap(mgr_, other.mgr_);
+            std::swap(index_, other.index_);
+            std::swap(gen_, other.gen_);
+        }
+
+        void reset() noexcept
+        {
+            slice_ref().swap(*this);
+        }
+
+        // give up the reference without releasing it, and return the
+        // manager it refers to (used by remote_free_queue)
+        //
+
+        details::manager_base *detach() noexcept
+        {
+            auto m = mgr_;
+            mgr_ = nullptr;
+            return m;
+        }
+
+        Manager *manager() const noexcept
+        {
+            return mgr_;
+        }
+
+        uint32_t index() const noexcept
+        {
+            return index_;
+        }
+
+        uint32_t generation() const noexcept
+        {
+            return gen_;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return mgr_ != nullptr;
+        }
+
+    private:
+        Manager * mgr_;
+        uint32_t  index_;
+        uint32_t  gen_;
+    };
+
+    // the slot of the handle has not been recycled since
+    //
+
+    template <typename Manager>
+    inline bool valid(slice_ref<Manager> const &r)
+    {
+        return r && r.manager()->valid(r.index(), r.generation());
+    }
+
+    // destroy the objects of the slot and hand it back to the free list of
+    // its manager: the handle is reset, its copies become stale.
+    //
+
+    template <typename Manager>
+    inline void recycle(slice_ref<Manager> &r)
+    {
+        r.manager()->recycle(r.index(), r.generation());
+        r.reset();
+    }
+
+    namespace details
+    {
+        // the accessors check the generation of the handles in debug
+        // builds only
+        //
+
+        template <typename Manager>
+        inline uint32_t checked_index(slice_ref<Manager> const &r)
+        {
+#ifndef NDEBUG
+            if (!mem::valid(r))
+                throw std::runtime_error("mem::slice_ref: stale handle");
+#endif
+            return r.index();
+        }
+    }
+
+    // get, has and emplace for compact handles
+    //
+
+    template <size_t N, typename Manager>
+    inline auto get(slice_ref<Manager> const &r) -> decltype(r.manager()->template slot<N>(0))
+    {
+        return r.manager()->template slot<N>(details::checked_index(r));
+    }
+
+    template <typename T, typename Manager>
+    inline auto get(slice_ref<Manager> const &r) -> decltype(r.manager()->template slot<T>(0))
+    {
+        return r.manager()->template slot<T>(details::checked_index(r));
+    }
+
+    template <size_t N, typename Manager>
+    inline auto has(slice_ref<Manager> const &r) -> decltype(r.manager()->template has<N>(0))
+    {
+        return r.manager()->template has<N>(details::checked_index(r));
+    }
+
+    template <typename T, typename Manager>
+    inline auto has(slice_ref<Manager> const &r) -> decltype(r.manager()->template has<T>(0))
+    {
+        return r.manager()->template has<T>(details::checked_index(r));
+    }
+
+    template <size_t N, typename Manager, typename ...As>
+    inline auto emplace(slice_ref<Manager> const &r, As && ...args) -> decltype(r.manager()->template slot<N>(0))
+    {
+        return r.manager()->template emplace<N>(details::checked_index(r), std::forward<As>(args)...);
+    }
+
+    template <typename T, typename Manager, typename ...As>
+    inline auto emplace(slice_ref<Manager> const &r, As && ...args) -> decltype(r.manager()->template slot<T>(0))
+    {
+        return r.manager()->template emplace<T>(details::checked_index(r), std::forward<As>(args)...);
+    }
+
+    // total size of the memory of the layers, including the padding
+    // required by their alignment
+    //
+
+    template <size_t M, typename ...Ts>
+    constexpr inline
+    size_t sizeof_mem()
+    {
+        return details::layout<Ts...>::size(M);
+    }
+
+    template <typename ...Ts>
+    constexpr inline
+    size_t sizeof_mem(size_t m)
+    {
+        return details::layout<Ts...>::size(m);
+    }
+
+    // number of slots whose layers fit in the given bytes
+    //
+
+    template <typename ...Ts>
+    inline
+    size_t slots_in(size_t bytes)
+    {
+        size_t lo = 0, hi = bytes;
+        while (lo < hi)
+        {
+            auto mid = lo + (hi - lo + 1) / 2;
+            if (sizeof_mem<Ts...>(mid) <= bytes)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        return lo;
+    }
+
+    // capacity of the managers chosen at runtime (see allocator_options)
+    //
+
+    enum : size_t { dynamic_capacity = 0 };
+
+    namespace details
+    {
+        // bounded single-producer single-consumer ring
+        //
+
+        template <typename T>
+        struct spsc_ring
+        {
+            explicit spsc_ring(size_t capacity)
+            : mask_(round_pow2(capacity) - 1)
+            , buffer_(new T[mask_ + 1])
+            , tail_(0)
+            , head_cache_(0)
+            , head_(0)
+            , tail_cache_(0)
+            {}
+
+            spsc_ring(const spsc_ring &) = delete;
+            spsc_ring& operator=(const spsc_ring &) = delete;
+
+            // producer side
+            //
+
+            bool
+            push(T &&value)
+            {
+                auto t = tail_.load(std::memory_order_relaxed);
+                if (t - head_cache_ > mask_)
+                {
+                    head_cache_ = head_.load(std::memory_order_acquire);
+                    if (t - head_cache_ > mask_)
+                        return false;
+                }
+
+                buffer_[t & mask_] = std::move(value);
+                tail_.store(t + 1, std::memory_order_release);
+                return true;
+            }
+
+            // producer side: true if a push would fail
+            //
+
+            bool
+            full()
+            {
+                auto t = tail_.load(std::memory_order_relaxed);
+                if (t - head_cache_ > mask_)
+                    head_cache_ = head_.load(std::memory_order_acquire);
+                return t - head_cache_ > mask_;
+            }
+
+            // consumer side
+            //
+
+            bool
+            pop(T &value)
+            {
+                auto h = head_.load(std::memory_order_relaxed);
+                if (h == tail_cache_)
+                {
+                    tail_cache_ = tail_.load(std::memory_order_acquire);
+                    if (h == tail_cache_)
+                        return false;
+                }
+
+                value = std::move(buffer_[h & mask_]);
+                head_.store(h + 1, std::memory_order_release);
+                return true;
+            }
+
+            size_t
+            capacity() const
+            {
+                return mask_ + 1;
+            }
+
+        private:
+
+            static size_t
+            round_pow2(size_t n)
+            {
+                size_t r = 1;
+                while (r < n)
+                    r <<= 1;
+                return r;
+            }
+
+            const size_t mask_;
+            std::unique_ptr<T[]> buffer_;
+
+            alignas(64) std::atomic<size_t> tail_;
+            size_t head_cache_;
+
+            alignas(64) std::atomic<size_t> head_;
+            size_t tail_cache_;
+        };
+
+    } // namespace details
+
+
+    /////////////////////////////////////////////////////////////
+    // remote_free_queue: releases of local handles (local_ptr and
+    // local_unique_ptr) performed by a thread other than the allocating
+    // one. A consumer thread pushes the handles it drops; the allocating
+    // thread drains the queue and applies the releases in batches, with
+    // one decrement per run of handles that refer to the same manager.
+    // One queue per consumer thread.
+    //
+
+    struct remote_free_queue
+    {
+        explicit remote_free_queue(size_t capacity = 4096)
+        : ring_(capacity)
+        {}
+
+        // the queue must be destroyed by the allocating thread
+        //
+
+        ~remote_free_queue()
+        {
+            drain();
+        }
+
+        // consumer side: hand the reference back, false if the queue is
+        // full (the handle is left untouched)
+        //
+
+        template <typename Handle>
+        bool
+        try_push(Handle &&h)
+        {
+            if (ring_.full())
+                return false;
+
+            if (auto m = h.detach())
+                ring_.push(std::move(m));
+
+            return true;
+        }
+
+        template <typename Handle>
+        void
+        push(Handle &&h)
+        {
+            while (!try_push(std::forward<Handle>(h)))
+                std::this_thread::yield();
+        }
+
+        // allocating side: apply the pending releases, return their number
+        //
+
+        size_t
+        drain()
+        {
+            details::manager_base *m, *run = nullptr;
+            size_t n = 0, total = 0;
+
+            while (ring_.pop(m))
+            {
+                if (m != run)
+                {
+                    if (run)
+                        run->release(n);
+                    run = m;
+                    n = 0;
+                }
+                n++;
+                total++;
+            }
+
+            if (run)
+                run->release(n);
+
+            return total;
+        }
+
+    private:
+        details::spsc_ring<details::manager_base *> ring_;
+    };
+
+
+    /////////////////////////////////////////////////////////////
+    // allocator options
+    //
+
+    // how the surplus arenas of the manager pool give memory back to the OS
+    //
+
+    enum class trim_mode
+    {
+        none,           // keep the pages resident
+        dontneed,       // madvise(MADV_DONTNEED): pages are dropped immediately
+        free            // madvise(MADV_FREE): pages are dropped lazily, under memory pressure
+    };
+
+    // provisioning of the next slice manager, so that the rollover of a full
+    // manager does not pay for its creation and page faults:
+    //
+
+    enum class standby_mode
+    {
+        none,           // the next manager is created at rollover
+        incremental,    // a standby manager is faulted in a slice of pages every 64 allocations
+        thread          // a helper thread prepares and faults in the standby manager
+    };
+
+    // backing store of the slice manager arenas. Huge page backings fall
+    // back to smaller pages when the system cannot provide them:
+    // huge_1g -> huge_2m -> transparent -> mmap.
+    //
+
+    enum class arena_backing
+    {
+        heap,           // malloc()
+        mmap,           // private anonymous mapping
+        transparent,    // private anonymous mapping, madvise(MADV_HUGEPAGE)
+        huge_2m,        // MAP_HUGETLB, 2MB pages
+        huge_1g,        // MAP_HUGETLB, 1GB pages
+        external        // memory region of the caller (see external_region)
+    };
+
+    // NUMA placement of the slice manager arenas. The policy applies to
+    // mappings only: a heap backing is replaced by mmap. On single-node
+    // machines, or when the kernel refuses the policy, the arena is left
+    // unbound (numa_node() is -1), unless numa_strict is set: the creation
+    // of the arena fails then.
+    //
+
+    enum class numa_placement
+    {
+        none,           // first-touch policy of the kernel
+        local,          // node of the CPU that creates the manager
+        node            // node given by arena_options::numa_node
+    };
+
+    struct arena_options
+    {
+        arena_options()
+        : backing(
+#ifdef MSLICE_USE_MMAP
+            arena_backing::mmap
+#else
+            arena_backing::heap
+#endif
+          )
+        , prefault(false)
+        , numa(numa_placement::none)
+        , numa_node(0)
+        , numa_strict(false)
+        {}
+
+        arena_backing backing;  // requested backing store
+        bool prefault;          // populate the pages when the arena is created
+
+        numa_placement numa;    // NUMA placement of the arena
+        int  numa_node;         // node for numa_placement::node
+        bool numa_strict;       // MPOL_BIND instead of MPOL_PREFERRED
+    };
+
+    // memory region provided by the caller (ring buffers, pre-registered or
+    // mlocked memory) that a slice manager lays its layers over, instead of
+    // allocating an arena. The region must be aligned to the alignment of
+    // the layers. release(addr, size) is invoked when the manager goes
+    // away, that is when the last of its slices dies.
+    //
+
+    struct external_region
+    {
+        void  *addr;
+        size_t size;
+        std::function<void(void *, size_t)> release;
+    };
+
+    struct allocator_options
+    {
+        allocator_options()
+        : pool_low_watermark(1)
+        , pool_high_watermark(4)
+        , pool_trim(trim_mode::dontneed)
+        , standby(standby_mode::none)
+        , capacity(131072)
+        , capacity_min(0)
+        , capacity_max(0)
+        , adapt_pinned(2)
+        , adapt_period(std::chrono::milliseconds(10))
+        , region_bytes(0)
+        , recycle(false)
+        , diagnostics_sample(1)
+        , arena()
+        {}
+
+        size_t    pool_low_watermark;   // released managers kept hot (resident)
+        size_t    pool_high_watermark;  // released managers kept at all (0 disables the pool)
+        trim_mode pool_trim;            // how managers above the low watermark are trimmed
+
+        standby_mode standby;           // provisioning of the next manager
+
+        // slots per manager of the allocators with dynamic_capacity. With
+        // capacity_min < capacity_max the capacity adapts at every
+        // rollover: it is halved when more than adapt_pinned retired
+        // managers are pinned by slices, and doubled when no manager is
+        // pinned and the previous rollover is less than adapt_period ago.
+        //
+
+        size_t capacity;
+        size_t capacity_min;
+        size_t capacity_max;
+        size_t adapt_pinned;
+        std::chrono::nanoseconds adapt_period;
+
+        size_t region_bytes;            // secondary region of the byte regions (mem::bytes) per manager, 0 for 256 bytes per slot
+
+        // the slots released by mem::recycle() are reused by new_slice_ref()
+        // of the current manager, which rolls over only when it has no free
+        // slot left. The byte regions of the recycled slots are reclaimed
+        // with the manager only.
+        //
+
+        bool recycle;
+
+        size_t diagnostics_sample;      // call site of one allocation every diagnostics_sample (MSLICE_DIAGNOSTICS)
+
+        arena_options arena;            // backing store of the manager arenas
+    };
+
+    // counters of the allocators and of the slice managers, compiled in
+    // with MSLICE_STATS only: they are 0 otherwise.
+    //
+
+#ifdef MSLICE_STATS
+#define MSLICE_STAT(x) x
+#else
+#define MSLICE_STAT(x)
+#endif
+
+    // diagnostics of the managers pinned by long-lived slices: with
+    // MSLICE_DIAGNOSTICS the allocators sample the call sites of the
+    // allocations (see policy_slice_allocator::pinned()).
+    //
+
+#ifdef MSLICE_DIAGNOSTICS
+#define MSLICE_DIAG(x) x
+#define MSLICE_DIAG_NOINLINE __attribute__((noinline))
+#else
+#define MSLICE_DIAG(x)
+#define MSLICE_DIAG_NOINLINE
+#endif
+
+    // retired manager still alive: the slots it holds cannot be reused
+    // until all its handles go away
+    //
+
+    struct pinned_manager
+    {
+        void const *manager;            // address of the manager
+        size_t slots;                   // slots allocated from the manager
+        size_t handles;                 // handles still referring to the manager
+        size_t arena_bytes;             // bytes of the arena kept alive
+
+        // sampled call sites of the allocations from the manager, with the
+        // number of slots (MSLICE_DIAGNOSTICS)
+        std::vector<std::pair<void const *, size_t>> sites;
+    };
+
+    // snapshot of the state of an allocator
+    //
+
+    struct allocator_stats
+    {
+        allocator_stats()
+        : backing(arena_backing::heap)
+        , numa_node(-1)
+        , numa_resident_node(-1)
+        , pool_size(0)
+        , live_managers(0)
+        , slots_in_use(0)
+        , slots_pinned(0)
+        , arena_bytes(0)
+        , allocations(0)
+        , rollovers(0)
+        , managers_created(0)
+        , managers_reused(0)
+        , managers_released(0)
+        , capacity(0)
+        , standby_managers(0)
+        {}
+
+        arena_backing backing;          // backing store of the current arena
+        int    numa_node;               // node the current arena is bound to, -1 if unbound
+        int    numa_resident_node;      // node holding the first page of the current arena, -1 if unknown
+        size_t pool_size;               // released managers cached for reuse
+        size_t live_managers;           // current manager and retired ones pinned by slices
+        size_t slots_in_use;            // slots allocated from the current manager
+        size_t slots_pinned;            // slots allocated from retired managers still alive
+        size_t arena_bytes;             // arena bytes of the live and cached managers
+
+        uint64_t allocations;           // slices allocated (MSLICE_STATS)
+        uint64_t rollovers;             // full managers replaced (MSLICE_STATS)
+        uint64_t managers_created;      // managers created (MSLICE_STATS)
+        uint64_t managers_reused;       // managers taken from the pool (MSLICE_STATS)
+        uint64_t managers_released;     // managers whose last reference went away (MSLICE_STATS)
+
+        size_t capacity;                // slots of the managers being created
+        size_t standby_managers;        // standby manager ready for the next rollover (0 or 1)
+    };
+
+
+    /////////////////////////////////////////////////////////////////////////
+    // stats_page: shared memory page (POSIX shm) where an allocator
+    // publishes its stats for an external monitor. Snapshots are protected
+    // by a seqlock: the writer never waits for the readers.
+    //
+
+    struct stats_page
+    {
+        enum : uint32_t { magic = 0x6d736c63, version = 3 };
+        enum : size_t   { fields = 15 };
+
+        struct layout
+        {
+            std::atomic<uint32_t> seq;
+            uint32_t magic;
+            uint32_t version;
+            uint32_t fields;
+            std::atomic<uint64_t> value[stats_page::fields];
+        };
+
+        // create (writer) or open read-only (reader) the page named name
+        //
+
+        explicit stats_page(std::string name, bool create = true)
+        : name_(std::move(name))
+        , owner_(create)
+        , page_(nullptr)
+        {
+            auto fd = shm_open(name_.c_str(), create ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+            if (fd < 0)
+                throw std::runtime_error("stats_page: cannot open " + name_);
+
+            if (create && ftruncate(fd, sizeof(layout)) != 0) {
+                close(fd);
+                throw std::runtime_error("stats_page: cannot size " + name_);
+            }
+
+            struct stat st;
+            if (!create && (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(layout))) {
+                close(fd);
+                throw std::runtime_error("stats_page: bad page " + name_);
+            }
+
+            auto addr = mmap(nullptr, sizeof(layout), create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+
+            if (addr == MAP_FAILED)
+                throw std::runtime_error("stats_page: cannot map " + name_);
+
+            page_ = static_cast<layout *>(addr);
+
+            // the page may be left over by a writer that crashed in the
+            // middle of a publish (odd sequence): it is reset, the magic
+            // being written last
+
+            if (create) {
+                page_->magic = 0;
+                std::atomic_thread_fence(std::memory_order_release);
+
+                page_->seq.store(0, std::memory_order_relaxed);
+                for(size_t i = 0; i < fields; i++)
+                    page_->value[i].store(0, std::memory_order_relaxed);
+
+                page_->version = version;
+                page_->fields  = fields;
+
+                std::atomic_thread_fence(std::memory_order_release);
+                page_->magic = magic;
+            }
+            else if (page_->magic != magic || page_->version != version || page_->fields != fields) {
+                munmap(page_, sizeof(layout));
+                throw std::runtime_error("stats_page: bad page " + name_);
+            }
+        }
+
+        ~stats_page()
+        {
+            munmap(page_, sizeof(layout));
+            if (owner_)
+                shm_unlink(name_.c_str());
+        }
+
+        stats_page(const stats_page &) = delete;
+        stats_page& operator=(const stats_page &) = delete;
+
+        // writer side
+        //
+
+        void
+        publish(allocator_stats const &st)
+        {
+            uint64_t v[fields];
+            encode(st, v);
+
+            auto seq = page_->seq.load(std::memory_order_relaxed);
+
+            page_->seq.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            for(size_t i = 0; i < fields; i++)
+                page_->value[i].store(v[i], std::memory_order_relaxed);
+
+            page_->seq.store(seq + 2, std::memory_order_release);
+        }
+
+        // reader side: consistent snapshot of the last publish
+        //
+
+        allocator_stats
+        read() const
+        {
+            uint64_t v[fields];
+
+            for(;;)
+            {
+                auto seq = page_->seq.load(std::memory_order_acquire);
+                if (seq & 1) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                for(size_t i = 0; i < fields; i++)
+                    v[i] = page_->value[i].load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (page_->seq.load(std::memory_order_relaxed) == seq)
+                    break;
+            }
+
+            return decode(v);
+        }
+
+        // number of snapshots published so far
+        //
+
+        uint32_t
+        generation() const
+        {
+            return page_->seq.load(std::memory_order_acquire) / 2;
+        }
+
+    private:
+
+        static void
+        encode(allocator_stats const &st, uint64_t *v)
+        {
+            v[0]  = static_cast<uint64_t>(st.backing);
+            v[1]  = static_cast<uint64_t>(static_cast<int64_t>(st.numa_node));
+            v[2]  = static_cast<uint64_t>(static_cast<int64_t>(st.numa_resident_node));
+            v[3]  = st.pool_size;
+            v[4]  = st.live_managers;
+            v[5]  = st.slots_in_use;
+            v[6]  = st.slots_pinned;
+            v[7]  = st.arena_bytes;
+            v[8]  = st.allocations;
+            v[9]  = st.rollovers;
+            v[10] = st.managers_created;
+            v[11] = st.managers_reused;
+            v[12] = st.managers_released;
+            v[13] = st.capacity;
+            v[14] = st.standby_managers;
+        }
+
+        static allocator_stats
+        decode(uint64_t const *v)
+        {
+            allocator_stats st;
+            st.backing            = static_cast<arena_backing>(v[0]);
+            st.numa_node          = static_cast<int>(static_cast<int64_t>(v[1]));
+            st.numa_resident_node = static_cast<int>(static_cast<int64_t>(v[2]));
+            st.pool_size          = static_cast<size_t>(v[3]);
+            st.live_managers      = static_cast<size_t>(v[4]);
+            st.slots_in_use       = static_cast<size_t>(v[5]);
+            st.slots_pinned       = static_cast<size_t>(v[6]);
+            st.arena_bytes        = static_cast<size_t>(v[7]);
+            st.allocations        = v[8];
+            st.rollovers          = v[9];
+            st.managers_created   = v[10];
+            st.managers_reused    = v[11];
+            st.managers_released  = v[12];
+            st.capacity           = static_cast<size_t>(v[13]);
+            st.standby_managers   = static_cast<size_t>(v[14]);
+            return st;
+        }
+
+        std::string name_;
+        bool owner_;
+        layout *page_;
+    };
+
+
+    namespace details
+    {
+        // fault in the pages of [addr, addr+len) without changing their
+        // content
+        //
+
+        inline void
+        touch_pages(void *addr, size_t len)
+        {
+            auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            auto p    = static_cast<volatile char *>(addr);
+
+            for(size_t off = 0; off < len; off += page)
+                p[off] = p[off];
+        }
+
+        // give back to the OS the whole pages in [addr, addr+len), keeping
+        // the virtual reservation:
+        //
+
+        inline void
+        trim_pages(void *addr, size_t len, trim_mode mode)
+        {
+            if (mode == trim_mode::none)
+                return;
+
+            auto page  = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+            auto begin = (reinterpret_cast<uintptr_t>(addr) + page - 1) & ~(page - 1);
+            auto end   = (reinterpret_cast<uintptr_t>(addr) + len) & ~(page - 1);
+
+            if (end <= begin)
+                return;
+
+            int advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+            if (mode == trim_mode::free)
+                advice = MADV_FREE;
+#endif
+            madvise(reinterpret_cast<void *>(begin), end - begin, advice);
+        }
+
+
+        // raw NUMA syscalls (no dependency on libnuma):
+        //
+
+        enum : int
+        {
+            mpol_preferred  = 1,
+            mpol_bind       = 2,
+            mpol_f_node     = 1 << 0,
+            mpol_f_addr     = 1 << 1,
+            mpol_mf_move    = 1 << 1
+        };
+
+        // node of the CPU the calling thread runs on, -1 if unknown
+        //
+
+        inline int
+        current_numa_node()
+        {
+            unsigned int cpu, node;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+                return -1;
+            return static_cast<int>(node);
+        }
+
+        // bind the whole pages in [addr, addr+len) to the given node: 0 on
+        // success, the error of mbind otherwise
+        //
+
+        inline int
+        numa_bind(void *addr, size_t len, int node, bool strict)
+        {
+            unsigned long mask[16] = { 0 };
+            const auto bits = sizeof(unsigned long) * 8;
+
+            if (node < 0 || static_cast<size_t>(node) >= sizeof(mask) * 8)
+                return EINVAL;
+
+            auto page  = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+            auto begin = (reinterpret_cast<uintptr_t>(addr) + page - 1) & ~(page - 1);
+            auto end   = (reinterpret_cast<uintptr_t>(addr) + len) & ~(page - 1);
+
+            if (end <= begin)
+                return EINVAL;
+
+            mask[static_cast<size_t>(node) / bits] = 1UL << (static_cast<size_t>(node) % bits);
+
+            if (syscall(SYS_mbind, begin, end - begin, strict ? mpol_bind : mpol_preferred,
+                        mask, sizeof(mask) * 8 + 1, mpol_mf_move) != 0)
+                return errno;
+
+            return 0;
+        }
+
+        // node of the page holding addr, -1 if unknown
+        //
+
+        inline int
+        numa_node_of(void *addr)
+        {
+            int node = -1;
+            if (syscall(SYS_get_mempolicy, &node, nullptr, 0UL, addr, mpol_f_node | mpol_f_addr) != 0)
+                return -1;
+            return node;
+        }
+
+
+        // memory of a slice manager arena, with the backing store
+        // actually obtained from the system:
+        //
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+        struct arena
+        {
+            arena(size_t size, size_t align, arena_options const &opt, external_region *ext = nullptr)
+            : addr_(nullptr)
+            , size_(size)
+            , len_(0)
+            , align_(align)
+            , backing_(opt.backing)
+            , node_(-1)
+            , release_()
+            {
+                if (ext) {
+                    adopt(*ext);
+                    return;
+                }
+
+                // the policy must be set before the pages are faulted in:
+                // with NUMA placement the arena is prefaulted after mbind.
+
+                auto node     = opt.numa == numa_placement::local ? current_numa_node() :
+                                opt.numa == numa_placement::node  ? opt.numa_node : -1;
+                auto populate = opt.prefault && opt.numa == numa_placement::none;
+
+                // mbind on the heap would rebind the neighbouring pages, and
+                // the policy would outlive free()
+
+                if (opt.numa != numa_placement::none && backing_ == arena_backing::heap)
+                    backing_ = arena_backing::mmap;
+
+                map_arena(populate);
+
+                if (node >= 0)
+                {
+                    auto err = numa_bind(addr_, len_, node, opt.numa_strict);
+                    if (err == 0)
+                        node_ = node;
+                    else if (opt.numa_strict) {
+                        release();
+                        throw std::runtime_error("slice_manager: cannot bind the arena to NUMA node " + std::to_string(node) +
+                                                 ": " + strerror(err));
+                    }
+                }
+
+                if (opt.prefault && !populate)
+                    touch(addr_, size_);
+            }
+
+            ~arena()
+            {
+                release();
+            }
+
+            arena(const arena &) = delete;
+            arena& operator=(const arena &) = delete;
+
+            void *
+            addr() const
+            {
+                return addr_;
+            }
+
+            size_t
+            size() const
+            {
+                return size_;
+            }
+
+            arena_backing
+            backing() const
+            {
+                return backing_;
+            }
+
+            // node the arena is bound to, -1 if unbound
+            //
+
+            int
+            numa_node() const
+            {
+                return node_;
+            }
+
+        private:
+
+            void
+            release()
+            {
+                if (backing_ == arena_backing::external) {
+                    if (release_)
+                        release_(addr_, len_);
+                }
+                else if (backing_ == arena_backing::heap)
+                    free(addr_);
+                else
+                    munmap(addr_, len_);
+            }
+
+            // the layers are laid over the region of the caller, which is
+            // handed back at release
+            //
+
+            void
+            adopt(external_region &ext)
+            {
+                if (ext.addr == nullptr || ext.size < size_)
+                    throw std::runtime_error("slice_manager: external region too small");
+
+                if (reinterpret_cast<uintptr_t>(ext.addr) & (align_ - 1))
+                    throw std::runtime_error("slice_manager: external region not aligned");
+
+                addr_    = ext.addr;
+                len_     = ext.size;
+                backing_ = arena_backing::external;
+                release_ = std::move(ext.release);
+            }
+
+            void
+            map_arena(bool populate)
+            {
+                if (backing_ == arena_backing::huge_1g) {
+                    if (map_hugetlb(size_t(1) << 30, 30, populate))
+                        return;
+                    backing_ = arena_backing::huge_2m;
+                }
+
+                if (backing_ == arena_backing::huge_2m) {
+                    if (map_hugetlb(size_t(1) << 21, 21, populate))
+                        return;
+                    backing_ = arena_backing::transparent;
+                }
+
+                if (backing_ == arena_backing::transparent) {
+                    if (map_transparent(size_t(1) << 21, populate))
+                        return;
+                    backing_ = arena_backing::mmap;
+                }
+
+                if (backing_ == arena_backing::mmap) {
+                    len_  = round_up(size_, page_size());
+                    addr_ = align_ > page_size() ? map_aligned(len_, align_, populate ? MAP_POPULATE : 0)
+                                                 : map(len_, populate ? MAP_POPULATE : 0);
+                }
+                else {
+                    if (align_ <= alignof(std::max_align_t))
+                        addr_ = malloc(size_);
+                    else if (posix_memalign(&addr_, align_, size_) != 0)
+                        addr_ = nullptr;
+
+                    if (addr_ && populate)
+                        touch(addr_, size_);
+                }
+
+                if (addr_ == nullptr)
+                    throw std::runtime_error("slice_manager: out of memory");
+
+                if (reinterpret_cast<uintptr_t>(addr_) & (align_ - 1)) {
+                    release();
+                    throw std::runtime_error("slice_manager: arena alignment not supported");
+                }
+            }
+
+            static size_t
+            page_size()
+            {
+                return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            }
+
+            static size_t
+            round_up(size_t n, size_t align)
+            {
+                return (n + align - 1) & ~(align - 1);
+            }
+
+            static void *
+            map(size_t len, int flags)
+            {
+                int extra = 0;
+#ifdef MAP_UNINITIALIZED
+                extra = MAP_UNINITIALIZED;
+#endif
+                auto p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extra | flags, -1, 0);
+                return p == MAP_FAILED ? nullptr : p;
+            }
+
+            // over-map to align the mapping, then unmap the head and the
+            // tail
+            //
+
+            static void *
+            map_aligned(size_t len, size_t align, int flags)
+            {
+                auto raw = static_cast<char *>(map(len + align, flags));
+                if (raw == nullptr)
+                    return nullptr;
+
+                auto base = reinterpret_cast<char *>(round_up(reinterpret_cast<uintptr_t>(raw), align));
+                if (base != raw)
+                    munmap(raw, static_cast<size_t>(base - raw));
+                munmap(base + len, static_cast<size_t>(raw + align - base));
+
+                return base;
+            }
+
+            static void
+            touch(void *addr, size_t len)
+            {
+                auto page = page_size();
+                for(size_t off = 0; off < len; off += page)
+                    static_cast<volatile char *>(addr)[off] = 0;
+            }
+
+            bool
+            map_hugetlb(size_t huge, int shift, bool prefault)
+            {
+#ifdef MAP_HUGETLB
+                len_  = round_up(size_, huge);
+                addr_ = map(len_, MAP_HUGETLB | (shift << MAP_HUGE_SHIFT) | (prefault ? MAP_POPULATE : 0));
+
+                // huge pages cannot be over-mapped: alignments beyond the
+                // page size fall back to the next backing
+
+                if (addr_ != nullptr && (reinterpret_cast<uintptr_t>(addr_) & (align_ - 1))) {
+                    munmap(addr_, len_);
+                    addr_ = nullptr;
+                }
+
+                return addr_ != nullptr;
+#else
+                (void)huge; (void)shift; (void)prefault;
+                return false;
+#endif
+            }
+
+            bool
+            map_transparent(size_t huge, bool prefault)
+            {
+#ifdef MADV_HUGEPAGE
+                // the arena is aligned to the huge page size (at least)
+
+                len_  = round_up(size_, huge);
+                addr_ = map_aligned(len_, std::max(huge, align_), 0);
+                if (addr_ == nullptr)
+                    return false;
+
+                if (madvise(addr_, len_, MADV_HUGEPAGE) != 0)
+                    backing_ = arena_backing::mmap;
+
+                if (prefault)
+                    touch(addr_, size_);
+
+                return true;
+#else
+                (void)huge; (void)prefault;
+                return false;
+#endif
+            }
+
+            void *  addr_;
+            size_t  size_;
+            size_t  len_;
+            size_t  align_;
+            arena_backing backing_;
+            int     node_;
+
+            std::function<void(void *, size_t)> release_;
+        };
+
+
+        // per-allocator state shared with its managers: the list of live
+        // managers (the current one and the retired ones still pinned by
+        // slices) and a bounded LIFO cache of released managers. Managers
+        // hold a weak reference to the pool of the allocator they come
+        // from, and are given back to it by the dispose hook, possibly from
+        // a different thread.
+        //
+
+        template <typename Manager>
+        struct manager_pool
+        {
+            explicit manager_pool(allocator_options const &opt)
+            : opt_(opt)
+            , mutex_()
+            , cache_()
+            , live_(nullptr)
+            , nlive_(0)
+            {
+                cache_.reserve(opt_.pool_high_watermark);
+            }
+
+            ~manager_pool()
+            {
+                for(auto m : cache_)
+                    delete m;
+            }
+
+            manager_pool(const manager_pool &) = delete;
+            manager_pool& operator=(const manager_pool &) = delete;
+
+            // get the most recently released manager, nullptr if empty.
+            // Cached managers of a different capacity are dropped. A
+            // standby manager (live = false) stays off the live list until
+            // enlisted.
+            //
+
+            Manager *
+            get(size_t capacity, bool live = true)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                while (!cache_.empty() && cache_.back()->capacity() != capacity)
+                {
+                    delete cache_.back();
+                    cache_.pop_back();
+                }
+
+                if (cache_.empty())
+                    return nullptr;
+
+                auto m = cache_.back();
+                cache_.pop_back();
+                if (live)
+                    link(m);
+                MSLICE_STAT(reused_++);
+                return m;
+            }
+
+            // register a new manager, as live unless it is a standby
+            //
+
+            void
+            attach(Manager *m, bool live = true)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (live)
+                    link(m);
+                MSLICE_STAT(created_++);
+            }
+
+            // a standby manager handed out at rollover becomes live
+            //
+
+            void
+            enlist(Manager *m)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                link(m);
+            }
+
+            // unlink a released manager from the live list: for_each no
+            // longer reaches it. A standby never enlisted is not linked.
+            //
+
+            void
+            detach(Manager *m)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                unlink(m);
+                MSLICE_STAT(released_++);
+            }
+
+            // take back a detached and cleared manager, false if the pool
+            // is full
+            //
+
+            bool
+            put(Manager *m)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                if (opt_.pool_high_watermark == 0)
+                    return false;
+
+                if (cache_.size() == opt_.pool_high_watermark)
+                {
+                    delete cache_.front();
+                    cache_.erase(cache_.begin());
+                }
+
+                cache_.push_back(m);
+
+                // the manager that just left the hot window is trimmed
+                //
+
+                if (cache_.size() > opt_.pool_low_watermark)
+                    cache_[cache_.size() - opt_.pool_low_watermark - 1]->trim(opt_.pool_trim);
+
+                return true;
+            }
+
+            // invoke fun on every live manager. The managers are taken
+            // from a snapshot of the live list and fun runs unlocked, each
+            // manager pinned by one extra reference: fun may release
+            // handles and allocate. Managers being released by other
+            // threads, and the ones not yet handed out (standby), are
+            // skipped.
+            //
+
+            template <typename Fun>
+            void
+            for_each(Fun fun)
+            {
+                struct pin
+                {
+                    manager_base *m;
+                    std::shared_ptr<void> owner;    // shared_refcount, refs_ otherwise
+                };
+
+                struct unpin
+                {
+                    std::vector<pin> &pins;
+                    ~unpin()
+                    {
+                        for(auto &p : pins)
+                            if (!p.owner)
+                                p.m->release();
+                        pins.clear();
+                    }
+                };
+
+                std::vector<pin> pins;
+                unpin guard{pins};
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+
+                    pins.reserve(nlive_);
+
+                    for(auto m = live_; m != nullptr; m = m->next_)
+                    {
+                        auto owner = m->owner_.lock();
+                        if (!owner && m->refs_ == 0)
+                            continue;
+                        if (!owner)
+                            m->acquire();
+                        pins.push_back(pin{ m, std::move(owner) });
+                    }
+                }
+
+                for(auto &p : pins)
+                    fun(*static_cast<Manager *>(p.m));
+            }
+
+            size_t
+            size()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return cache_.size();
+            }
+
+            size_t
+            live()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return nlive_;
+            }
+
+            // fill the fields of the pool in a snapshot: exclude is the
+            // current manager of the allocator
+            //
+
+            void
+            stats(allocator_stats &st, manager_base const *exclude)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                st.pool_size     = cache_.size();
+                st.live_managers = nlive_;
+
+                for(auto m = live_; m != nullptr; m = m->next_)
+                {
+                    if (m != exclude)
+                        st.slots_pinned += static_cast<Manager *>(m)->size();
+                    st.arena_bytes += static_cast<Manager *>(m)->bytes();
+                }
+
+                for(auto m : cache_)
+                    st.arena_bytes += m->bytes();
+
+#ifdef MSLICE_STATS
+                st.managers_created  = created_;
+                st.managers_reused   = reused_;
+                st.managers_released = released_;
+#endif
+            }
+
+        private:
+
+            void
+            link(manager_base *m)
+            {
+                m->prev_ = nullptr;
+                m->next_ = live_;
+                if (live_)
+                    live_->prev_ = m;
+                live_ = m;
+                nlive_++;
+            }
+
+            void
+            unlink(manager_base *m)
+            {
+                if (m->prev_ == nullptr && live_ != m)
+                    return;
+
+                if (m->prev_)
+                    m->prev_->next_ = m->next_;
+                else
+                    live_ = m->next_;
+                if (m->next_)
+                    m->next_->prev_ = m->prev_;
+                m->prev_ = m->next_ = nullptr;
+                nlive_--;
+            }
+
+            allocator_options opt_;
+
+            std::mutex mutex_;
+            std::vector<Manager *> cache_;
+
+            manager_base *live_;
+            size_t nlive_;
+
+#ifdef MSLICE_STATS
+            uint64_t created_  = 0;
+            uint64_t reused_   = 0;
+            uint64_t released_ = 0;
+#endif
+        };
+
+
+        // helper thread that prepares a standby manager, fully faulted in,
+        // for the allocating thread (standby_mode::thread). If the standby
+        // is not ready at rollover, the allocator creates the manager.
+        //
+
+        template <typename Manager>
+        struct manager_provisioner
+        {
+            explicit manager_provisioner(std::function<Manager *()> make)
+            : make_(std::move(make))
+            , mutex_()
+            , cond_()
+            , ready_(nullptr)
+            , slices_(false)
+            , stop_(false)
+            , thread_()
+            {
+                thread_ = std::thread([this] { run(); });
+            }
+
+            ~manager_provisioner()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stop_ = true;
+                }
+
+                cond_.notify_one();
+                thread_.join();
+
+                if (ready_)
+                    Manager::dispose(ready_);
+            }
+
+            manager_provisioner(const manager_provisioner &) = delete;
+            manager_provisioner& operator=(const manager_provisioner &) = delete;
+
+            // take the standby manager, nullptr if not ready. The next one
+            // materializes its slices if requested.
+            //
+
+            Manager *
+            take(bool slices)
+            {
+                std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+
+                if (!lock || ready_ == nullptr)
+                    return nullptr;
+
+                auto m = ready_;
+                ready_  = nullptr;
+                slices_ = slices;
+
+                cond_.notify_one();
+                return m;
+            }
+
+            bool
+            ready()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return ready_ != nullptr;
+            }
+
+        private:
+
+            void
+            run()
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+
+                while (!stop_)
+                {
+                    if (ready_) {
+                        cond_.wait(lock);
+                        continue;
+                    }
+
+                    auto slices = slices_;
+
+                    lock.unlock();
+
+                    Manager *m = nullptr;
+
+                    try
+                    {
+                        m = make_();
+                        m->provision(SIZE_MAX, slices);
+                    }
+                    catch(...)
+                    {
+                        // out of memory: leave the rollovers to the allocator
+
+                        if (m)
+                            Manager::dispose(m);
+
+                        lock.lock();
+                        break;
+                    }
+
+                    lock.lock();
+                    ready_ = m;
+                }
+            }
+
+            std::function<Manager *()> make_;
+
+            std::mutex mutex_;
+            std::condition_variable cond_;
+
+            Manager *ready_;
+            bool slices_;
+            bool stop_;
+
+            std::thread thread_;
+        };
+
+    } // namespace details
+
+
+    /////////////////////////////////////////////////////////////
+    // layer_view: the dense column of a layer of a manager, with a
+    // bitmap of the slots that hold a live object.
+    //
+
+    template <typename T>
+    struct layer_view
+    {
+        T *              data;      // first element of the layer
+        size_t           size;      // number of slots allocated so far
+        uint64_t const * live;      // liveness bitmap, one bit per slot
+
+        details::presence_type const * presence;    // presence masks of the slots (lazy layers only)
+        unsigned                       bit;         // bit of the layer in the presence masks
+
+        T &
+        operator[](size_t i) const
+        {
+            return data[i];
+        }
+
+        bool
+        is_live(size_t i) const
+        {
+            return (live[i / 64] >> (i % 64)) & 1;
+        }
+
+        // the slot is live and, for lazy layers, its object exists
+        //
+
+        bool
+        is_present(size_t i) const
+        {
+            return is_live(i) && (presence == nullptr || ((presence[i] >> bit) & 1));
+        }
+
+        // number of 64-bit words of the bitmap covering size slots
+        //
+
+        size_t
+        words() const
+        {
+            return (size + 63) / 64;
+        }
+
+        T *begin() const
+        {
+            return data;
+        }
+
+        T *end() const
+        {
+            return data + size;
+        }
+    };
+
+
+    /////////////////////////////////////////////////////////////
+    // slice manager: utility class that manages layers of memory.
+    // M is the number of slots, or dynamic_capacity to set it at
+    // construction time.
+    //
+
+    template <size_t M, typename ...Ts>
+    struct slice_manager : details::manager_base
+    {
+        typedef slice<Ts...> slice_type;
+        typedef details::manager_pool<slice_manager> pool_type;
+
+        // prototype objects of the layers (used by prototyped layers only)
+        //
+
+        typedef std::tuple<std::shared_ptr<details::layer_type<Ts> const>...> prototypes_type;
+
+        // with recycle, the slots released by mem::recycle() go back to a
+        // free list and are reused by alloc_index()
+        //
+
+        explicit slice_manager(arena_options const &opt = arena_options(),
+                               std::weak_ptr<pool_type> pool = std::weak_ptr<pool_type>(),
+                               size_t capacity = M,
+                               size_t region_bytes = 0,
+                               bool recycle = false)
+        : slice_manager(opt, nullptr, std::move(pool), capacity, region_bytes, recycle)
+        {}
+
+        // manager laid over a region of the caller: with dynamic_capacity
+        // and no capacity given, it holds as many slots as the region fits.
+        // External managers are never recycled by the pool.
+        //
+
+        explicit slice_manager(external_region ext,
+                               std::weak_ptr<pool_type> pool = std::weak_ptr<pool_type>(),
+                               size_t capacity = M)
+        : slice_manager(arena_options(), &ext, std::move(pool), capacity ? capacity : slots_in<Ts...>(ext.size), 0, false)
+        {}
+
+    private:
+
+        slice_manager(arena_options const &opt, external_region *ext, std::weak_ptr<pool_type> pool,
+                      size_t capacity, size_t region_bytes, bool recycle)
+        : details::manager_base(&slice_manager::dispose)
+        , capacity_(M != dynamic_capacity ? M : capacity)
+        , index_(0)
+        , layer_()
+        , slice_()
+        , live_(new uint64_t[(capacity_ + 63) / 64]())
+        , live_end_(0)
+        , presence_(details::any_lazy<Ts...>::value ? new details::presence_type[capacity_] : nullptr)
+        , prototypes_()
+        , arena_(sizeof_mem<Ts...>(capacity_), details::layout<Ts...>::alignment(), opt, ext)
+        , provisioned_(opt.prefault ? arena_.size() : 0)
+        , region_(details::any_region<Ts...>::value ? new details::arena(region_bytes ? region_bytes : 256 * capacity_, 64, opt) : nullptr)
+        , cursor_{ region_ ? static_cast<uint8_t *>(region_->addr()) : nullptr, region_ ? region_->size() : 0, 0 }
+        , gen_(recycle ? new uint32_t[capacity_]() : nullptr)
+        , free_(recycle ? new uint32_t[capacity_] : nullptr)
+        , nfree_(0)
+#ifdef MSLICE_DIAGNOSTICS
+        , sites_(new void const *[capacity_]())
+#endif
+        , pool_(std::move(pool))
+        {
+            if (capacity_ == 0)
+                throw std::runtime_error("slice_manager: zero capacity");
+
+            details::allocate<details::layout<Ts...>>(layer_.tuple_, static_cast<char *>(arena_.addr()), capacity_, std::integral_constant<size_t, sizeof...(Ts)-1>());
+        }
+
+    public:
+
         ~slice_manager()
         {
-            details::destroy(layer_.tuple_, index_, std::integral_constant<size_t, sizeof...(Ts)-1>());
+            clear();
+        }
+
+        slice_manager(const slice_manager &) = delete;
+        slice_manager& operator=(const slice_manager &) = delete;
+
+        template <typename ...Xs>
+        slice_type *
+        alloc(Xs && ...packs)
+        {
+#ifndef NDEBUG
+            if (index_ == capacity())
+                throw std::runtime_error("slice_manager<Ts...>::alloc() overflow");
+#endif
+            auto s = slices();
+            construct_at(s[index_], index_, std::forward_as_tuple(std::forward<Xs>(packs)...));
+            return &s[index_++];
+        }
+
+        // construct a slice without materializing it (see slice_ref),
+        // return the index of its slot
+        //
+
+        template <typename ...Xs>
+        size_t
+        alloc_index(Xs && ...packs)
+        {
+            slice_type tmp;
+
+            if (nfree_ != 0)
+            {
+                auto i = free_[nfree_-1];
+                construct_at(tmp, i, std::forward_as_tuple(std::forward<Xs>(packs)...));
+                live_[i / 64] |= 1ULL << (i % 64);
+                nfree_--;
+                return i;
+            }
+#ifndef NDEBUG
+            if (index_ == capacity())
+                throw std::runtime_error("slice_manager<Ts...>::alloc_index() overflow");
+#endif
+            construct_at(tmp, index_, std::forward_as_tuple(std::forward<Xs>(packs)...));
+            return index_++;
+        }
+
+        // destroy the objects of the slot i, allocated with the given
+        // generation, and put it on the free list. The slot must come from
+        // alloc_index() of a recycling manager: a stale generation (the
+        // slot has been recycled already) throws.
+        //
+
+        void
+        recycle(size_t i, uint32_t generation)
+        {
+            if (!gen_ || !valid(i, generation) || (gen_[i] & 1) == 0)
+                throw std::runtime_error("slice_manager<Ts...>::recycle() invalid or stale slot");
+
+            details::destroy<std::tuple<Ts...>>(layer_.tuple_, i, i + 1, presence_.get(), std::integral_constant<size_t, sizeof...(Ts)-1>());
+            MSLICE_DIAG(sites_[i] = nullptr);
+
+            sync_live();
+            live_[i / 64] &= ~(1ULL << (i % 64));
+
+            gen_[i]++;
+            free_[nfree_++] = static_cast<uint32_t>(i);
+        }
+
+        // generation of the slot i: odd while the slot is allocated, bumped
+        // at every allocation and recycling (always 0 without recycling)
+        //
+
+        uint32_t
+        generation(size_t i) const
+        {
+            return gen_ ? gen_[i] : 0;
+        }
+
+        bool
+        valid(size_t i, uint32_t generation) const
+        {
+            return i < index_ && (gen_ ? gen_[i] == generation : !generation);
+        }
+
+        bool
+        recycling() const
+        {
+            return gen_ != nullptr;
+        }
+
+        // recycled slots waiting to be reused (size() - free_slots() are in use)
+        //
+
+        size_t
+        free_slots() const
+        {
+            return nfree_;
+        }
+
+        // construct n consecutive slices with the same arguments, return
+        // the first one
+        //
+
+        template <typename ...Xs>
+        slice_type *
+        alloc_n(size_t n, Xs && ...packs)
+        {
+#ifndef NDEBUG
+            if (n > capacity() - index_)
+                throw std::runtime_error("slice_manager<Ts...>::alloc_n() overflow");
+#endif
+            auto s     = slices();
+            auto first = index_;
+            auto args  = std::forward_as_tuple(packs...);
+
+            for(auto last = first + n; index_ != last; ++index_)
+                construct_at(s[index_], index_, args);
+
+            return &s[first];
+        }
+
+        size_t
+        size() const
+        {
+            return index_;
+        }
+
+        // take the first n slots as allocated: their objects already exist
+        // in an external region (persistent arenas)
+        //
+
+        void
+        restore(size_t n)
+        {
+            if (n > capacity())
+                throw std::runtime_error("slice_manager<Ts...>::restore() beyond capacity");
+            index_ = n;
+        }
+
+        size_t
+        available() const
+        {
+            return capacity() - index_;
+        }
+
+        // number of slots (a constant unless dynamic_capacity)
+        //
+
+        size_t
+        capacity() const
+        {
+            return M != dynamic_capacity ? M : capacity_;
+        }
+
+        // size of the layers in the arena, and of the secondary region of
+        // the byte regions
+        //
+
+        size_t
+        bytes() const
+        {
+            return sizeof_mem<Ts...>(capacity()) + cursor_.size;
+        }
+
+        // bytes left in the secondary region
+        //
+
+        size_t
+        region_available() const
+        {
+            return cursor_.size - cursor_.used;
+        }
+
+        // bytes of the secondary region required by a slot built from the
+        // given packs (0 without byte region layers)
+        //
+
+        template <typename ...Xs>
+        static size_t
+        region_request(Xs const & ...packs)
+        {
+            return details::any_region<Ts...>::value ?
+                   details::region_request<std::tuple<Ts...>>(std::forward_as_tuple(packs...), std::integral_constant<size_t, sizeof...(Ts)-1>()) : 0;
+        }
+
+        // address of the object of the layer N (or of type T) in the slot i
+        //
+
+        template <size_t N>
+        typename std::tuple_element<N, typename slice_type::tuple_type>::type
+        slot(size_t i) const
+        {
+            return std::get<N>(layer_.tuple_) + i;
+        }
+
+        template <typename T>
+        T *
+        slot(size_t i) const
+        {
+            return slot<details::type_index<T, details::layer_type<Ts>...>::value>(i);
+        }
+
+        // presence of the object of the layer N (or of type T) in the slot
+        // i, and construction of the lazy ones
+        //
+
+        template <size_t N>
+        bool
+        has(size_t i) const
+        {
+            return !details::layer_traits_at<N, Ts...>::lazy || ((presence_[i] >> N) & 1);
+        }
+
+        template <typename T>
+        bool
+        has(size_t i) const
+        {
+            return has<details::type_index<T, details::layer_type<Ts>...>::value>(i);
+        }
+
+        template <size_t N, typename ...As>
+        typename std::tuple_element<N, typename slice_type::tuple_type>::type
+        emplace(size_t i, As && ...args)
+        {
+            static_assert(details::layer_traits_at<N, Ts...>::lazy, "slice_manager::emplace: the layer is not lazy");
+
+            return details::emplace_object(slot<N>(i), presence_[i], N, std::forward<As>(args)...);
+        }
+
+        template <typename T, typename ...As>
+        T *
+        emplace(size_t i, As && ...args)
+        {
+            return emplace<details::type_index<T, details::layer_type<Ts>...>::value>(i, std::forward<As>(args)...);
+        }
+
+        // fault in the next bytes of the arena ahead of its use and, once the
+        // arena is resident, materialize the slices if requested. Return
+        // true when the manager is fully provisioned.
+        //
+
+        bool
+        provision(size_t bytes, bool slices)
+        {
+            auto size = arena_.size();
+
+            if (provisioned_ < size)
+            {
+                auto len = std::min(bytes, size - provisioned_);
+                details::touch_pages(static_cast<char *>(arena_.addr()) + provisioned_, len);
+                provisioned_ += len;
+            }
+
+            if (provisioned_ < size)
+                return false;
+
+            if (slices)
+                this->slices();
+
+            return true;
+        }
+
+        // true if the slices have been materialized
+        //
+
+        bool
+        materialized() const
+        {
+            return static_cast<bool>(slice_);
+        }
+
+#ifdef MSLICE_DIAGNOSTICS
+        // call site of the allocation of the slot i (nullptr if not sampled)
+        //
+
+        void
+        site(size_t i, void const *addr)
+        {
+            sites_[i] = addr;
+        }
+
+        void const *
+        site(size_t i) const
+        {
+            return sites_[i];
+        }
+#endif
+
+        // install the prototypes copied into the objects of prototyped
+        // layers allocated with an empty pack
+        //
+
+        void
+        prototypes(prototypes_type const &protos)
+        {
+            prototypes_ = protos;
+        }
+
+        // backing store actually obtained for the arena
+        //
+
+        arena_backing
+        backing() const
+        {
+            return arena_.backing();
+        }
+
+        bool
+        external() const
+        {
+            return arena_.backing() == arena_backing::external;
+        }
+
+        // NUMA node the arena is bound to (-1 if unbound) and node that
+        // holds its first page (-1 if unknown)
+        //
+
+        int
+        numa_node() const
+        {
+            return arena_.numa_node();
+        }
+
+        int
+        numa_resident_node() const
+        {
+            return details::numa_node_of(arena_.addr());
+        }
+
+        // destroy the objects and make the whole capacity available again
+        //
+
+        void
+        clear()
+        {
+            if (gen_)
+            {
+                // the recycled slots have no objects
+
+                for(size_t i = 0; i < index_; i++)
+                    if (gen_[i] & 1)
+                        details::destroy<std::tuple<Ts...>>(layer_.tuple_, i, i + 1, presence_.get(), std::integral_constant<size_t, sizeof...(Ts)-1>());
+
+                std::fill(gen_.get(), gen_.get() + index_, 0);
+                nfree_ = 0;
+            }
+            else
+                details::destroy<std::tuple<Ts...>>(layer_.tuple_, 0, index_, presence_.get(), std::integral_constant<size_t, sizeof...(Ts)-1>());
+
+            MSLICE_DIAG(std::fill(sites_.get(), sites_.get() + index_, nullptr));
+            std::fill(live_.get(), live_.get() + (live_end_ + 63) / 64, 0);
+            live_end_ = 0;
+            index_ = 0;
+            cursor_.used = 0;
+        }
+
+        // columnar view of a layer, by index or by type
+        //
+
+        template <size_t N>
+        layer_view<details::layer_type<typename std::tuple_element<N, std::tuple<Ts...>>::type>>
+        layer()
+        {
+            sync_live();
+            return { std::get<N>(layer_.tuple_), index_, live_.get(),
+                     details::layer_traits_at<N, Ts...>::lazy ? presence_.get() : nullptr, N };
+        }
+
+        template <typename T>
+        layer_view<T>
+        layer()
+        {
+            return layer<details::type_index<T, details::layer_type<Ts>...>::value>();
+        }
+
+        // give the pages back to the OS, keeping the virtual reservation
+        //
+
+        void
+        trim(trim_mode mode)
+        {
+            if (mode != trim_mode::none)
+                provisioned_ = 0;
+
+            details::trim_pages(arena_.addr(), arena_.size(), mode);
+            if (slice_)
+                details::trim_pages(slice_.get(), sizeof(slice_type) * capacity(), mode);
+            details::trim_pages(live_.get(), sizeof(uint64_t) * ((capacity() + 63) / 64), mode);
+            if (region_)
+                details::trim_pages(region_->addr(), region_->size(), mode);
+        }
+
+        // invoked when the last reference goes away: the manager is
+        // recycled by the pool of its allocator, if still alive. It leaves
+        // the live list before being cleared, as the allocator may walk
+        // the live managers (for_each_layer, stats...) from its thread.
+        //
+
+        static void
+        dispose(details::manager_base *b)
+        {
+            auto m = static_cast<slice_manager *>(b);
+            if (auto pool = m->pool_.lock())
+            {
+                pool->detach(m);
+
+                if (!m->external()) {
+                    m->clear();
+                    if (pool->put(m))
+                        return;
+                }
+            }
+            delete m;
+        }
+
+    private:
+
+        // the array of slices is only materialized for the handles that
+        // point to a slice_type (slice_ref computes the addresses)
+        //
+
+        slice_type *
+        slices()
+        {
+            if (!slice_)
+                slice_.reset(new slice_type[capacity()]);
+            return slice_.get();
+        }
+
+        template <typename Tuple>
+        void
+        construct_at(slice_type &s, size_t i, Tuple && packs)
+        {
+            details::presence_type *mask = nullptr;
+
+            if (details::any_lazy<Ts...>::value) {
+                mask = &presence_[i];
+                *mask = 0;
+                details::bind_presence(s, mask);
+            }
+
+            details::construct<std::tuple<Ts...>>(s.tuple_, layer_.tuple_, i, prototypes_, mask, &cursor_, std::integral_constant<size_t, sizeof...(Ts)-1>(),
+                               std::forward<Tuple>(packs),
+                               typename details::gens<
+                                    std::tuple_size<
+                                        typename std::decay<
+                                            typename std::tuple_element<sizeof...(Ts)-1,
+                                                typename std::decay<Tuple>::type
+                                            >::type
+                                        >::type
+                                    >::value
+                                >::type());
+            if (gen_)
+                gen_[i]++;
+        }
+
+        // objects are constructed in bump order: the liveness bitmap is
+        // brought up to date lazily, when a view is taken.
+        //
+
+        void
+        sync_live()
+        {
+            for(; live_end_ < index_ && (live_end_ % 64) != 0; ++live_end_)
+                live_[live_end_ / 64] |= 1ULL << (live_end_ % 64);
+            for(; live_end_ + 64 <= index_; live_end_ += 64)
+                live_[live_end_ / 64] = ~0ULL;
+            for(; live_end_ < index_; ++live_end_)
+                live_[live_end_ / 64] |= 1ULL << (live_end_ % 64);
+        }
+
+        size_t      capacity_;
+        size_t      index_;
+        slice_type  layer_;
+
+        std::unique_ptr<slice_type[]> slice_;
+        std::unique_ptr<uint64_t[]> live_;
+        size_t live_end_;
+
+        std::unique_ptr<details::presence_type[]> presence_;
+
+        prototypes_type prototypes_;
+
+        details::arena arena_;
+        size_t provisioned_;
+
+        std::unique_ptr<details::arena> region_;
+        details::region_cursor cursor_;
+
+        std::unique_ptr<uint32_t[]> gen_;       // generations of the slots (recycling managers only)
+        std::unique_ptr<uint32_t[]> free_;      // stack of the recycled slots
+        size_t nfree_;
+
+#ifdef MSLICE_DIAGNOSTICS
+        std::unique_ptr<void const *[]> sites_;
+#endif
+
+        std::weak_ptr<pool_type> pool_;
+    };
+
+
+    /////////////////////////////////////////////////////////////
+    // refcount policies: select the handle returned by the allocator
+    //
+
+    // std::shared_ptr aliasing the manager (atomic, thread-safe)
+    //
+
+    struct shared_refcount
+    {
+        template <typename T>
+        using pointer = std::shared_ptr<T>;
+
+        template <typename Manager>
+        using manager_pointer = std::shared_ptr<Manager>;
+
+        template <typename Manager>
+        static manager_pointer<Manager>
+        make_manager(Manager *m)
+        {
+            manager_pointer<Manager> ret(m, details::manager_disposer());
+            m->owner_ = ret;
+            return ret;
+        }
+
+        template <typename T, typename Manager>
+        static pointer<T>
+        make_pointer(manager_pointer<Manager> const &m, T *p)
+        {
+            return pointer<T>(m, p);
+        }
+    };
+
+    // local_ptr with a non-atomic reference count (single-thread)
+    //
+
+    struct local_refcount
+    {
+        template <typename T>
+        using pointer = local_ptr<T>;
+
+        template <typename Manager>
+        using manager_pointer = local_ptr<Manager>;
+
+        template <typename Manager>
+        static manager_pointer<Manager>
+        make_manager(Manager *m)
+        {
+            return manager_pointer<Manager>(m, m);
+        }
+
+        template <typename T, typename Manager>
+        static pointer<T>
+        make_pointer(manager_pointer<Manager> const &m, T *p)
+        {
+            return pointer<T>(m.get(), p);
+        }
+    };
+
+    // move-only local_unique_ptr (single-thread)
+    //
+
+    struct unique_refcount
+    {
+        template <typename T>
+        using pointer = local_unique_ptr<T>;
+
+        template <typename Manager>
+        using manager_pointer = local_ptr<Manager>;
+
+        template <typename Manager>
+        static manager_pointer<Manager>
+        make_manager(Manager *m)
+        {
+            return manager_pointer<Manager>(m, m);
+        }
+
+        template <typename T, typename Manager>
+        static pointer<T>
+        make_pointer(manager_pointer<Manager> const &m, T *p)
+        {
+            return pointer<T>(m.get(), p);
+        }
+    };
+
+
+    /////////////////////////////////////////////////////////////
+    // slice_batch: slices allocated in a single pass. The batch is made of
+    // at most two runs of contiguous slices (the batch may cross a manager
+    // boundary) and holds a single reference to the manager of each run.
+    //
+
+    template <typename Policy, typename Manager>
+    struct slice_batch
+    {
+        typedef typename Manager::slice_type slice_type;
+        typedef typename Policy::template manager_pointer<Manager> manager_pointer;
+
+        struct run
+        {
+            slice_type *data;
+            size_t      size;
+        };
+
+        struct iterator
+        {
+            typedef std::forward_iterator_tag iterator_category;
+            typedef slice_type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef slice_type * pointer;
+            typedef slice_type & reference;
+
+            iterator(slice_batch const *b, size_t i)
+            : batch_(b)
+            , index_(i)
+            {}
+
+            slice_type & operator*() const
+            {
+                return (*batch_)[index_];
+            }
+
+            slice_type * operator->() const
+            {
+                return &(*batch_)[index_];
+            }
+
+            iterator & operator++()
+            {
+                ++index_;
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                iterator ret(*this);
+                ++index_;
+                return ret;
+            }
+
+            bool operator==(iterator const &other) const
+            {
+                return index_ == other.index_;
+            }
+
+            bool operator!=(iterator const &other) const
+            {
+                return index_ != other.index_;
+            }
+
+        private:
+            slice_batch const *batch_;
+            size_t index_;
+        };
+
+        slice_batch()
+        : nruns_(0)
+        , run_()
+        , manager_()
+        {}
+
+        void
+        append(manager_pointer const &m, slice_type *data, size_t n)
+        {
+            run_[nruns_].data = data;
+            run_[nruns_].size = n;
+            manager_[nruns_++] = m;
+        }
+
+        size_t
+        size() const
+        {
+            return run_[0].size + run_[1].size;
+        }
+
+        bool
+        empty() const
+        {
+            return size() == 0;
+        }
+
+        slice_type &
+        operator[](size_t i) const
+        {
+            return i < run_[0].size ? run_[0].data[i] : run_[1].data[i - run_[0].size];
+        }
+
+        iterator begin() const
+        {
+            return iterator(this, 0);
+        }
+
+        iterator end() const
+        {
+            return iterator(this, size());
+        }
+
+        // contiguous runs of the batch (0, 1 or 2)
+        //
+
+        size_t
+        runs() const
+        {
+            return nruns_;
+        }
+
+        run const &
+        get_run(size_t r) const
+        {
+            return run_[r];
+        }
+
+        // a handle to the i-th slice, that outlives the batch
+        //
+
+        typename Policy::template pointer<slice_type>
+        share(size_t i) const
+        {
+            return i < run_[0].size ? Policy::make_pointer(manager_[0], &run_[0].data[i])
+                                    : Policy::make_pointer(manager_[1], &run_[1].data[i - run_[0].size]);
+        }
+
+        void
+        reset()
+        {
+            *this = slice_batch();
+        }
+
+    private:
+        size_t nruns_;
+        run run_[2];
+        manager_pointer manager_[2];
+    };
+
+
+    ////////////////////////////////
+    // policy_slice_allocator class: Ns slots per manager, or
+    // dynamic_capacity to set them at runtime (allocator_options::capacity)
+
+    template <typename Policy, size_t Ns, typename ...Ts>
+    struct policy_slice_allocator
+    {
+        typedef slice<Ts...> slice_type;
+        typedef slice_manager<Ns, Ts...> manager_type;
+
+        template <typename T>
+        using pointer = typename Policy::template pointer<T>;
+
+        explicit policy_slice_allocator(allocator_options const &opt = allocator_options())
+        : arena_(opt.arena)
+        , pool_(std::make_shared<typename manager_type::pool_type>(opt))
+        , prototypes_()
+        , capacity_(Ns != dynamic_capacity ? Ns : opt.capacity)
+        , capacity_min_(Ns == dynamic_capacity && opt.capacity_min < opt.capacity_max ? opt.capacity_min : capacity())
+        , capacity_max_(Ns == dynamic_capacity && opt.capacity_min < opt.capacity_max ? opt.capacity_max : capacity())
+        , adapt_pinned_(opt.adapt_pinned)
+        , adapt_period_(opt.adapt_period)
+        , last_rollover_(std::chrono::steady_clock::now())
+        , region_bytes_(opt.region_bytes)
+        , recycle_(opt.recycle)
+        , standby_(nullptr)
+        , standby_step_(opt.standby == standby_mode::incremental ? provision_step() : 0)
+        , standby_mark_(0)
+        , stats_page_(nullptr)
+#ifdef MSLICE_DIAGNOSTICS
+        , sample_rate_(std::max<size_t>(opt.diagnostics_sample, 1))
+#endif
+        , manager_()
+        , provisioner_()
+        {
+            // managers cannot be empty, and the slot indices of slice_ref
+            // are 32-bit
+            //
+
+            if (capacity_min_ == 0 || (Ns == dynamic_capacity && capacity_max_ - 1 > UINT32_MAX))
+                throw std::runtime_error("policy_slice_allocator: invalid capacity");
+
+            if (capacity() < capacity_min_ || capacity() > capacity_max_)
+                capacity_.store(std::min(std::max(capacity(), capacity_min_), capacity_max_), std::memory_order_relaxed);
+
+            manager_ = Policy::make_manager(new_manager());
+
+            if (opt.standby == standby_mode::thread)
+            {
+                // the helper thread creates the managers: local placement
+                // refers to the node of the allocating thread.
+
+                if (arena_.numa == numa_placement::local) {
+                    arena_.numa      = numa_placement::node;
+                    arena_.numa_node = details::current_numa_node();
+                }
+
+                provisioner_.reset(new details::manager_provisioner<manager_type>([this] { return create_manager(false); }));
+            }
+        }
+
+        ~policy_slice_allocator()
+        {
+            provisioner_.reset();
+            if (standby_)
+                manager_type::dispose(standby_);
+        }
+
+        policy_slice_allocator(const policy_slice_allocator &) = delete;
+        policy_slice_allocator& operator=(const policy_slice_allocator &) = delete;
+
+        template <typename ...Xs>
+        MSLICE_DIAG_NOINLINE pointer<slice_type>
+        new_slice(Xs && ... packs)
+        {
+            reset_manager(manager_type::region_request(packs...));
+            auto p = manager_->alloc(std::forward<Xs>(packs)...);
+            MSLICE_STAT(allocations_++);
+            MSLICE_DIAG(sample_site(1, __builtin_return_address(0)));
+            provision_standby();
+            return Policy::make_pointer(manager_, p);
+        }
+
+        template <typename T, typename ...Xs>
+        MSLICE_DIAG_NOINLINE pointer<T>
+        new_shared(Xs && ... args)
+        {
+            reset_manager(manager_type::region_request(std::forward_as_tuple(args...)));
+            auto p = manager_->alloc(std::forward_as_tuple(std::forward<Xs>(args)...));
+            MSLICE_STAT(allocations_++);
+            MSLICE_DIAG(sample_site(1, __builtin_return_address(0)));
+            provision_standby();
+            return Policy::make_pointer(manager_, mem::get<T>(*p));
+        }
+
+        // allocate a slice and return a compact handle to it: no slice_type
+        // is materialized. The managers must be reference counted by the
+        // handles (local_refcount, unique_refcount).
+        //
+
+        template <typename ...Xs>
+        MSLICE_DIAG_NOINLINE slice_ref<manager_type>
+        new_slice_ref(Xs && ... packs)
+        {
+            static_assert(std::is_same<typename Policy::template manager_pointer<manager_type>, local_ptr<manager_type>>::value,
+                          "policy_slice_allocator::new_slice_ref: the policy does not count references in the manager");
+            static_assert(Ns == dynamic_capacity || Ns - 1 <= UINT32_MAX, "policy_slice_allocator::new_slice_ref: too many slots for a 32-bit index");
+
+            reset_manager(manager_type::region_request(packs...), true);
+            auto i = manager_->alloc_index(std::forward<Xs>(packs)...);
+            MSLICE_STAT(allocations_++);
+            MSLICE_DIAG(sample_site(1, __builtin_return_address(0)));
+            provision_standby();
+            return slice_ref<manager_type>(manager_.get(), static_cast<uint32_t>(i), manager_->generation(i));
+        }
+
+        // allocate n slices (at most the minimum capacity) built from the
+        // same packs in a single pass: the batch holds one reference per
+        // manager involved.
+        //
+
+        template <typename ...Xs>
+        MSLICE_DIAG_NOINLINE slice_batch<Policy, manager_type>
+        new_slices(size_t n, Xs && ... packs)
+        {
+            auto region = manager_type::region_request(packs...);
+
+            if (n > capacity_min_ || region * n > region_size(capacity_min_))
+                throw std::runtime_error("policy_slice_allocator::new_slices(): batch larger than a manager");
+
+            slice_batch<Policy, manager_type> ret;
+
+            while (n != 0)
+            {
+                reset_manager(region);
+                auto k = std::min(n, manager_->available());
+                if (region)
+                    k = std::min(k, manager_->region_available() / region);
+                ret.append(manager_, manager_->alloc_n(k, packs...), k);
+                MSLICE_STAT(allocations_ += k);
+                MSLICE_DIAG(sample_site(k, __builtin_return_address(0)));
+                provision_standby();
+                n -= k;
+            }
+
+            return ret;
+        }
+
+        // allocate the next slices from a manager laid over a region of the
+        // caller (zero copy over ring buffers, pre-registered memory), until
+        // it is full. The current manager is retired.
+        //
+
+        void
+        adopt(external_region ext)
+        {
+            auto m = new manager_type(std::move(ext), pool_, Ns == dynamic_capacity ? 0 : Ns);
+            m->prototypes(prototypes_);
+            pool_->attach(m);
+
+            manager_ = manager_pointer();
+            manager_ = Policy::make_manager(m);
+            standby_mark_ = 0;
+        }
+
+        // retire the current manager now rather than when it is full: the
+        // release callback of an external region runs as soon as its slices
+        // die.
+        //
+
+        void
+        retire()
+        {
+            rollover();
+        }
+
+        // slots of the managers being created
+        //
+
+        size_t
+        capacity() const
+        {
+            return Ns != dynamic_capacity ? Ns : capacity_.load(std::memory_order_relaxed);
+        }
+
+        // backing store of the current manager arena
+        //
+
+        arena_backing
+        backing() const
+        {
+            return manager_->backing();
+        }
+
+        allocator_stats
+        stats() const
+        {
+            allocator_stats ret;
+            ret.backing            = manager_->backing();
+            ret.numa_node          = manager_->numa_node();
+            ret.numa_resident_node = manager_->numa_resident_node();
+            ret.slots_in_use       = manager_->size();
+
+            ret.capacity           = capacity();
+
+            pool_->stats(ret, manager_.get());
+
+            ret.standby_managers = standby_ != nullptr || (provisioner_ && provisioner_->ready());
+
+#ifdef MSLICE_STATS
+            ret.allocations        = allocations_;
+            ret.rollovers          = rollovers_;
+#endif
+            return ret;
+        }
+
+        // retired managers still alive, pinned by the handles of their slots.
+        // It must be called by the thread that allocates.
+        //
+
+        std::vector<pinned_manager>
+        pinned() const
+        {
+            std::vector<pinned_manager> ret;
+            auto current = manager_.get();
+
+            pool_->for_each([&](manager_type &m)
+            {
+                if (&m == current || m.size() == 0)
+                    return;
+
+                pinned_manager p;
+                p.manager     = &m;
+                p.slots       = m.size();
+                p.handles     = m.handles() - 1;    // the pin of for_each
+                p.arena_bytes = m.bytes();
+
+#ifdef MSLICE_DIAGNOSTICS
+                std::vector<void const *> sites;
+                for(size_t i = 0; i < m.size(); i++)
+                    if (auto s = m.site(i))
+                        sites.push_back(s);
+
+                std::sort(sites.begin(), sites.end());
+
+                for(size_t i = 0; i < sites.size(); )
+                {
+                    auto j = i;
+                    while (j < sites.size() && sites[j] == sites[i])
+                        j++;
+                    p.sites.emplace_back(sites[i], j - i);
+                    i = j;
+                }
+#endif
+                ret.push_back(std::move(p));
+            });
+
+            return ret;
+        }
+
+        // publish a snapshot of the stats at every rollover (and at every
+        // publish_stats()) to a shared memory page, nullptr to stop
+        //
+
+        void
+        export_stats(stats_page *page)
+        {
+            stats_page_ = page;
+            publish_stats();
+        }
+
+        void
+        publish_stats()
+        {
+            if (stats_page_)
+                stats_page_->publish(stats());
+        }
+
+        // number of released managers cached for reuse
+        //
+
+        size_t
+        pool_size() const
+        {
+            return pool_->size();
+        }
+
+        // set the prototype of the layer N (or of the layer of type T):
+        // objects of prototyped layers allocated with an empty pack are
+        // copied from it.
+        //
+
+        template <size_t N>
+        void
+        prototype(details::layer_type<typename std::tuple_element<N, std::tuple<Ts...>>::type> const &value)
+        {
+            static_assert(static_cast<int>(details::layer_traits_at<N, Ts...>::init) == details::init_prototype,
+                          "policy_slice_allocator::prototype: the layer is not prototyped");
+
+            typedef details::layer_type<typename std::tuple_element<N, std::tuple<Ts...>>::type> value_type;
+
+            std::get<N>(prototypes_) = std::make_shared<value_type const>(value);
+            manager_->prototypes(prototypes_);
+            if (standby_)
+                standby_->prototypes(prototypes_);
+        }
+
+        template <typename T>
+        void
+        prototype(T const &value)
+        {
+            prototype<details::type_index<T, details::layer_type<Ts>...>::value>(value);
+        }
+
+        // visit the layer N (or the layer of type T) of every live manager,
+        // the current one and the retired ones still pinned by slices. It
+        // must be called by the thread that allocates.
+        //
+
+        template <size_t N, typename Fun>
+        void
+        for_each_layer(Fun fun)
+        {
+            pool_->for_each([&](manager_type &m) { fun(m.template layer<N>()); });
+        }
+
+        template <typename T, typename Fun>
+        void
+        for_each_layer(Fun fun)
+        {
+            pool_->for_each([&](manager_type &m) { fun(m.template layer<T>()); });
+        }
+
+    private:
+
+        // roll over when the current manager is full (unless the next slot
+        // can be a recycled one), or when its secondary region cannot hold
+        // the byte regions of the next slot
+        //
+
+        void reset_manager(size_t region = 0, bool recycled = false)
+        {
+            if (!manager_ || (manager_->available() == 0 && !(recycled && manager_->free_slots())) || manager_->region_available() < region)
+            {
+                rollover();
+
+                if (manager_->region_available() < region)
+                    throw std::runtime_error("policy_slice_allocator: byte regions larger than the secondary region");
+            }
+        }
+
+        void rollover()
+        {
+            // retire the current manager first: if no slice pins it, the pool
+            // hands it back right away.
+
+            auto slices = manager_ && manager_->materialized();
+
+            MSLICE_STAT(if (manager_) rollovers_++);
+
+            manager_ = manager_pointer();
+
+            if (Ns == dynamic_capacity && capacity_min_ < capacity_max_)
+                adapt_capacity();
+
+            manager_ = Policy::make_manager(next_manager(slices));
+            standby_mark_ = 0;
+
+            if (stats_page_)
+                publish_stats();
+        }
+
+        size_t
+        region_size(size_t capacity) const
+        {
+            return region_bytes_ ? region_bytes_ : 256 * capacity;
+        }
+
+#ifdef MSLICE_DIAGNOSTICS
+        // record the call site of the last n slots allocated, one every
+        // diagnostics_sample allocations
+        //
+
+        void
+        sample_site(size_t n, void const *addr)
+        {
+            auto last = manager_->size();
+
+            for(auto i = last - n; i != last; ++i)
+                if (++sample_tick_ >= sample_rate_) {
+                    sample_tick_ = 0;
+                    manager_->site(i, addr);
+                }
+        }
+#endif
+
+        // adaptive capacity, at every rollover: shrink when long-lived
+        // slices pin too many arenas, grow when the rollovers are frequent
+        // and the retired managers are released right away
+        //
+
+        void
+        adapt_capacity()
+        {
+            auto now = std::chrono::steady_clock::now();
+
+            size_t pinned = 0;
+            pool_->for_each([&](manager_type &m) { pinned += m.size() != 0; });
+
+            auto cap = capacity();
+
+            if (pinned > adapt_pinned_)
+                cap = std::max(cap / 2, capacity_min_);
+            else if (pinned == 0 && now - last_rollover_ < adapt_period_)
+                cap = std::min(cap * 2, capacity_max_);
+
+            last_rollover_ = now;
+
+            if (cap != capacity())
+            {
+                capacity_.store(cap, std::memory_order_relaxed);
+                if (standby_step_)
+                    standby_step_ = provision_step();
+            }
+        }
+
+        // the standby manager, if any, replaces the full one (unless the
+        // capacity has changed in the meanwhile)
+        //
+
+        manager_type *
+        next_manager(bool slices)
+        {
+            manager_type *m = nullptr;
+
+            if (standby_) {
+                m = standby_;
+                standby_ = nullptr;
+            }
+            else if (provisioner_) {
+                m = provisioner_->take(slices);
+            }
+
+            if (m != nullptr && m->capacity() != capacity()) {
+                manager_type::dispose(m);
+                m = nullptr;
+            }
+
+            if (m == nullptr)
+                return new_manager();
+
+            m->prototypes(prototypes_);
+            pool_->enlist(m);
+            return m;
+        }
+
+        // standby_mode::incremental: every 64 allocations (or at every one,
+        // for small managers) fault in the next slice of the standby. The
+        // size of the current manager does not grow while recycled slots
+        // are reused: each step boundary is provisioned once.
+        //
+
+        void
+        provision_standby()
+        {
+            auto size = manager_->size();
+
+            if (standby_step_ == 0 || (size & standby_mask()) != 0 || size == standby_mark_)
+                return;
+
+            standby_mark_ = size;
+
+            if (standby_ == nullptr)
+                standby_ = new_manager(false);
+
+            standby_->provision(standby_step_, manager_->materialized());
+        }
+
+        size_t
+        provision_step() const
+        {
+            auto page  = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            auto steps = std::max<size_t>(capacity() / (standby_mask() + 1), 1);
+            auto bytes = (sizeof_mem<Ts...>(capacity()) + steps - 1) / steps;
+            return (bytes + page - 1) & ~(page - 1);
+        }
+
+        size_t
+        standby_mask() const
+        {
+            return capacity() >= 1024 ? 63 : 0;
+        }
+
+        manager_type *
+        new_manager(bool live = true)
+        {
+            auto m = create_manager(live);
+            m->prototypes(prototypes_);
+            return m;
+        }
+
+        // also invoked by the helper thread of standby_mode::thread. The
+        // standby managers (live = false) join the live list at rollover.
+        //
+
+        manager_type *
+        create_manager(bool live = true)
+        {
+            auto cap = capacity();
+            auto m = pool_->get(cap, live);
+            if (m == nullptr) {
+                m = new manager_type(arena_, pool_, cap, region_bytes_, recycle_);
+                pool_->attach(m, live);
+            }
+            return m;
+        }
+
+        typedef typename Policy::template manager_pointer<manager_type> manager_pointer;
+
+        arena_options arena_;
+
+        std::shared_ptr<typename manager_type::pool_type> pool_;
+        typename manager_type::prototypes_type prototypes_;
+
+        std::atomic<size_t> capacity_;      // read by the helper thread of standby_mode::thread
+        size_t capacity_min_;
+        size_t capacity_max_;
+        size_t adapt_pinned_;
+        std::chrono::nanoseconds adapt_period_;
+        std::chrono::steady_clock::time_point last_rollover_;
+
+        size_t region_bytes_;
+        bool recycle_;
+
+        manager_type *standby_;
+        size_t standby_step_;
+        size_t standby_mark_;       // size of the current manager at the last provisioned step
+
+        stats_page *stats_page_;
+
+#ifdef MSLICE_STATS
+        uint64_t allocations_ = 0;
+        uint64_t rollovers_   = 0;
+#endif
+
+#ifdef MSLICE_DIAGNOSTICS
+        size_t sample_rate_;
+        size_t sample_tick_ = 0;
+#endif
+
+        manager_pointer manager_;
+
+        std::unique_ptr<details::manager_provisioner<manager_type>> provisioner_;
+    };
+
+
+    template <size_t Ns, typename ...Ts>
+    using basic_slice_allocator = policy_slice_allocator<shared_refcount, Ns, Ts...>;
+
+    template <typename ...Ts>
+    using slice_allocator = basic_slice_allocator<131072, Ts...>;
+
+    template <typename ...Ts>
+    using local_slice_allocator = policy_slice_allocator<local_refcount, 131072, Ts...>;
+
+    template <typename ...Ts>
+    using unique_slice_allocator = policy_slice_allocator<unique_refcount, 131072, Ts...>;
+
+    template <typename ...Ts>
+    using dynamic_slice_allocator = basic_slice_allocator<dynamic_capacity, Ts...>;
+
+
+    namespace details
+    {
+        // unique identifier of allocator instances (never reused)
+        //
+
+        inline uint64_t
+        next_allocator_id()
+        {
+            static std::atomic<uint64_t> id(1);
+            return id.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    ///////////////////////////////////////////
+    // basic_concurrent_slice_allocator class:
+    // thread-safe facade, each thread allocates from its own
+    // basic_slice_allocator (and then its own current manager), found
+    // through a thread-local cache. The fast path takes no lock and
+    // touches no shared atomic. Handles are std::shared_ptr and can be
+    // released by any thread. The allocator of a thread is destroyed when
+    // the thread exits: its managers still pinned by slices go away with
+    // their last slice.
+    //
+
+    template <size_t Ns, typename ...Ts>
+    struct basic_concurrent_slice_allocator
+    {
+        typedef slice<Ts...> slice_type;
+        typedef basic_slice_allocator<Ns, Ts...> thread_allocator;
+
+        template <typename T>
+        using pointer = std::shared_ptr<T>;
+
+        explicit basic_concurrent_slice_allocator(allocator_options const &opt = allocator_options())
+        : id_(details::next_allocator_id())
+        , opt_(opt)
+        , registry_(std::make_shared<registry>())
+        {}
+
+        basic_concurrent_slice_allocator(const basic_concurrent_slice_allocator &) = delete;
+        basic_concurrent_slice_allocator& operator=(const basic_concurrent_slice_allocator &) = delete;
+
+        template <typename ...Xs>
+        pointer<slice_type>
+        new_slice(Xs && ... packs)
+        {
+            return local().new_slice(std::forward<Xs>(packs)...);
+        }
+
+        template <typename T, typename ...Xs>
+        pointer<T>
+        new_shared(Xs && ... args)
+        {
+            return local().template new_shared<T>(std::forward<Xs>(args)...);
+        }
+
+        template <typename ...Xs>
+        slice_batch<shared_refcount, slice_manager<Ns, Ts...>>
+        new_slices(size_t n, Xs && ... packs)
+        {
+            return local().new_slices(n, std::forward<Xs>(packs)...);
+        }
+
+        // the allocator of the calling thread
+        //
+
+        thread_allocator &
+        local()
+        {
+            auto & c = cache();
+            if (c.id == id_)
+                return *c.alloc;
+            return local_slow();
+        }
+
+        // number of live threads that allocated so far
+        //
+
+        size_t
+        threads() const
+        {
+            std::lock_guard<std::mutex> lock(registry_->mutex);
+            return registry_->allocators.size();
+        }
+
+    private:
+
+        // the allocators of the threads, shared with the threads so that
+        // an exiting thread can drop its own while the instance is alive
+        //
+
+        struct registry
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<thread_allocator>> allocators;
+        };
+
+        struct entry
+        {
+            uint64_t id;
+            thread_allocator *alloc;
+        };
+
+        struct owned_entry : entry
+        {
+            std::weak_ptr<registry> owner;
+        };
+
+        // all the allocators used by the thread, destroyed at thread exit
+        // (unless their instance is gone already)
+        //
+
+        struct thread_entries
+        {
+            std::vector<owned_entry> all;
+
+            ~thread_entries()
+            {
+                cache() = entry{ 0, nullptr };
+
+                for(auto &e : all)
+                {
+                    auto r = e.owner.lock();
+                    if (!r)
+                        continue;
+
+                    std::unique_ptr<thread_allocator> dead;
+                    {
+                        std::lock_guard<std::mutex> lock(r->mutex);
+                        auto it = std::find_if(r->allocators.begin(), r->allocators.end(),
+                                               [&](std::unique_ptr<thread_allocator> const &a) { return a.get() == e.alloc; });
+                        if (it != r->allocators.end()) {
+                            dead = std::move(*it);
+                            r->allocators.erase(it);
+                        }
+                    }
+                }
+            }
+        };
+
+        // the last allocator used by the thread (entries of destroyed
+        // instances never match again)
+        //
+
+        static entry &
+        cache()
+        {
+            static thread_local entry last = { 0, nullptr };
+            return last;
+        }
+
+        static std::vector<owned_entry> &
+        thread_allocators()
+        {
+            static thread_local thread_entries entries;
+            return entries.all;
+        }
+
+        thread_allocator &
+        local_slow()
+        {
+            auto & all = thread_allocators();
+
+            auto it = std::find_if(all.begin(), all.end(), [this](owned_entry const &e) { return e.id == id_; });
+            if (it == all.end())
+            {
+                std::unique_ptr<thread_allocator> a(new thread_allocator(opt_));
+
+                owned_entry e;
+                e.id    = id_;
+                e.alloc = a.get();
+                e.owner = registry_;
+                {
+                    std::lock_guard<std::mutex> lock(registry_->mutex);
+                    registry_->allocators.push_back(std::move(a));
+                }
+
+                all.push_back(std::move(e));
+                it = all.end() - 1;
+            }
+
+            cache() = *it;
+            return *it->alloc;
+        }
+
+        const uint64_t id_;
+        allocator_options opt_;
+
+        std::shared_ptr<registry> registry_;
+    };
+
+    template <typename ...Ts>
+    using concurrent_slice_allocator = basic_concurrent_slice_allocator<131072, Ts...>;
+
+
+    namespace details
+    {
+        template <typename ...Ts>
+        struct all_trivially_copyable : std::true_type { };
+
+        template <typename T, typename ...Ts>
+        struct all_trivially_copyable<T, Ts...> : std::integral_constant<bool, std::is_trivially_copyable<layer_type<T>>::value &&
+                                                                               all_trivially_copyable<Ts...>::value> { };
+    }
+
+
+    /////////////////////////////////////////////////////////////////////////
+    // persistent_arena: slice manager whose arena is a shared mapping of a
+    // file, for trivially copyable layers. The file holds a header with the
+    // layout (sizes, alignments and offsets of the layers, relative to the
+    // arena), the bump index and a bitmap of the live slots, so that a
+    // restarted process can map it again, at any address, and pick up the
+    // slots. Reopening checks the header checksum, the format and schema
+    // versions, and the layout against the one of the program. Slots are
+    // addressed by index; not thread-safe.
+    //
+
+    template <typename ...Ts>
+    struct persistent_arena
+    {
+        static_assert(details::all_trivially_copyable<Ts...>::value, "mem::persistent_arena: layers must be trivially copyable");
+        static_assert(!details::any_lazy<Ts...>::value && !details::any_region<Ts...>::value,
+                      "mem::persistent_arena: lazy and byte region layers are not supported");
+        static_assert(sizeof...(Ts) <= 32, "mem::persistent_arena: too many layers");
+
+        typedef slice_manager<dynamic_capacity, Ts...> manager_type;
+
+        enum : uint64_t { magic = 0x6d736c6963656172ULL };      // "msliceap"
+        enum : uint32_t { version = 1 };
+
+        struct header
+        {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t schema;            // version of the layer types, set by the program
+            uint32_t layers;
+            uint32_t clean;             // 1 if the last process closed the arena
+            uint64_t capacity;
+            uint64_t used;              // bump index
+            uint64_t live_offset;       // bitmap of the live slots
+            uint64_t data_offset;       // arena of the layers
+            uint64_t file_size;
+            uint64_t size[32];
+            uint64_t align[32];
+            uint64_t offset[32];
+            uint64_t checksum;          // of the immutable fields
+        };
+
+        // open the arena stored in path, or create it with the given
+        // capacity (0 to open an existing arena only)
+        //
+
+        persistent_arena(std::string path, size_t capacity, uint32_t schema = 0)
+        : path_(std::move(path))
+        , addr_(nullptr)
+        , len_(0)
+        , reopened_(false)
+        , clean_(true)
+        , header_(nullptr)
+        , live_(nullptr)
+        , manager_()
+        {
+            auto fd = open(path_.c_str(), O_RDWR | (capacity ? O_CREAT : 0), 0644);
+            if (fd < 0)
+                throw std::runtime_error("persistent_arena: cannot open " + path_);
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                throw std::runtime_error("persistent_arena: cannot stat " + path_);
+            }
+
+            reopened_ = st.st_size != 0;
+
+            if (reopened_)
+                len_ = static_cast<size_t>(st.st_size);
+            else {
+                len_ = file_size(capacity);
+                if (ftruncate(fd, static_cast<off_t>(len_)) != 0) {
+                    close(fd);
+                    throw std::runtime_error("persistent_arena: cannot size " + path_);
+                }
+            }
+
+            addr_ = mmap(nullptr, len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+
+            if (addr_ == MAP_FAILED)
+                throw std::runtime_error("persistent_arena: cannot map " + path_);
+
+            header_ = static_cast<header *>(addr_);
+
+            try
+            {
+                if (reopened_)
+                    check(capacity, schema);
+                else
+                    format(capacity, schema);
+
+                live_ = reinterpret_cast<uint64_t *>(static_cast<char *>(addr_) + header_->live_offset);
+
+                auto data = static_cast<char *>(addr_) + header_->data_offset;
+                manager_.reset(new manager_type(external_region{ data, len_ - header_->data_offset, nullptr },
+                                                std::weak_ptr<typename manager_type::pool_type>(), header_->capacity));
+
+                check_offsets(data, std::integral_constant<size_t, sizeof...(Ts)-1>());
+                if (!reopened_)
+                    header_->checksum = checksum(*header_);
 
-#ifdef MSLICE_USE_MMAP
-            munmap(mem_, sizeof_mem<M, Ts...>());
-#else
-            free(mem_);
-#endif
+                manager_->restore(header_->used);
+            }
+            catch(...)
+            {
+                manager_.reset();
+                munmap(addr_, len_);
+                throw;
+            }
+
+            clean_ = !reopened_ || header_->clean;
+            header_->clean = 0;
         }
 
-        slice_manager(const slice_manager &) = delete;
-        slice_manager& operator=(const slice_manager &) = delete;
+        ~persistent_arena()
+        {
+            manager_.reset();
+            header_->clean = 1;
+            msync(addr_, len_, MS_ASYNC);
+            munmap(addr_, len_);
+        }
+
+        persistent_arena(const persistent_arena &) = delete;
+        persistent_arena& operator=(const persistent_arena &) = delete;
+
+        // construct a slot, return its index
+        //
 
         template <typename ...Xs>
-        slice_type *
+        size_t
         alloc(Xs && ...packs)
         {
-#ifndef NDEBUG
-            if (index_ == M)
-                throw std::runtime_error("slice_manager<Ts...>::alloc() overflow");
-#endif
-            details::construct(slice_[index_].tuple_, layer_.tuple_, index_, std::integral_constant<size_t, sizeof...(Ts)-1>(),
-                               std::forward_as_tuple(std::forward<Xs>(packs)...),
-                               typename details::gens<
-                                    std::tuple_size<
-                                        typename std::decay<
-                                            typename std::tuple_element<sizeof...(Ts)-1,
-                                                decltype(std::forward_as_tuple(std::forward<Xs>(packs)...))
-                                            >::type
-                                        >::type
-                                    >::value
-                                >::type());
+            if (manager_->available() == 0)
+                throw std::runtime_error("persistent_arena: full");
+
+            auto i = manager_->alloc_index(std::forward<Xs>(packs)...);
+            live_[i / 64] |= 1ULL << (i % 64);
+            header_->used = i + 1;
+            return i;
+        }
+
+        // the slot is no longer live (its space is not reused)
+        //
+
+        void
+        erase(size_t i)
+        {
+            live_[i / 64] &= ~(1ULL << (i % 64));
+        }
+
+        bool
+        live(size_t i) const
+        {
+            return i < size() && ((live_[i / 64] >> (i % 64)) & 1);
+        }
+
+        // invoke fun(i) on every live slot
+        //
+
+        template <typename Fun>
+        void
+        for_each(Fun fun) const
+        {
+            for(size_t w = 0; w < (size() + 63) / 64; w++)
+                for(auto bits = live_[w]; bits; bits &= bits - 1)
+                    fun(w * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+        }
+
+        template <size_t N>
+        typename std::tuple_element<N, typename manager_type::slice_type::tuple_type>::type
+        slot(size_t i) const
+        {
+            return manager_->template slot<N>(i);
+        }
 
-            return &slice_[index_++];
+        template <typename T>
+        T *
+        slot(size_t i) const
+        {
+            return manager_->template slot<T>(i);
         }
 
         size_t
         size() const
         {
-            return index_;
+            return manager_->size();
+        }
+
+        size_t
+        capacity() const
+        {
+            return manager_->capacity();
+        }
+
+        // true if the arena has been reopened, and if the process that
+        // used it last closed it (false after a crash)
+        //
+
+        bool
+        reopened() const
+        {
+            return reopened_;
+        }
+
+        bool
+        clean() const
+        {
+            return clean_;
+        }
+
+        // write the dirty pages back to the file
+        //
+
+        void
+        sync()
+        {
+            msync(addr_, len_, MS_SYNC);
+        }
+
+        manager_type &
+        manager()
+        {
+            return *manager_;
         }
 
     private:
-        size_t      index_;
-        slice_type  layer_;
 
-        std::unique_ptr<slice_type[]> slice_;
-        void * mem_;
+        static size_t
+        page_size()
+        {
+            return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        }
+
+        static size_t
+        round_up(size_t n, size_t align)
+        {
+            return (n + align - 1) & ~(align - 1);
+        }
+
+        static size_t
+        live_offset()
+        {
+            return round_up(sizeof(header), page_size());
+        }
+
+        static size_t
+        data_offset(size_t capacity)
+        {
+            return round_up(live_offset() + (capacity + 63) / 64 * 8, std::max(page_size(), details::layout<Ts...>::alignment()));
+        }
+
+        static size_t
+        file_size(size_t capacity)
+        {
+            return round_up(data_offset(capacity) + sizeof_mem<Ts...>(capacity), page_size());
+        }
+
+        static uint64_t
+        checksum(header const &h)
+        {
+            // FNV-1a of the fields before used, and of the layout
+
+            uint64_t x = 0xcbf29ce484222325ULL;
+            auto mix = [&](void const *p, size_t n) {
+                for(size_t i = 0; i < n; i++)
+                    x = (x ^ static_cast<uint8_t const *>(p)[i]) * 0x100000001b3ULL;
+            };
+
+            mix(&h.magic, sizeof(h.magic));
+            mix(&h.version, sizeof(h.version));
+            mix(&h.schema, sizeof(h.schema));
+            mix(&h.layers, sizeof(h.layers));
+            mix(&h.capacity, sizeof(h.capacity));
+            mix(&h.live_offset, 3 * sizeof(uint64_t));
+            mix(h.size, sizeof(h.size) * 3);
+            return x;
+        }
+
+        void
+        format(size_t capacity, uint32_t schema)
+        {
+            auto &h = *header_;
+
+            h.magic       = magic;
+            h.version     = version;
+            h.schema      = schema;
+            h.layers      = sizeof...(Ts);
+            h.clean       = 0;
+            h.capacity    = capacity;
+            h.used        = 0;
+            h.live_offset = live_offset();
+            h.data_offset = data_offset(capacity);
+            h.file_size   = len_;
+
+            // offsets and checksum are filled once the layers are laid out
+
+            describe(h, std::integral_constant<size_t, sizeof...(Ts)-1>());
+        }
+
+        void
+        check(size_t capacity, uint32_t schema)
+        {
+            auto &h = *header_;
+
+            if (len_ < sizeof(header) || h.magic != magic || h.checksum != checksum(h))
+                throw std::runtime_error("persistent_arena: corrupted header in " + path_);
+
+            if (h.version != version)
+                throw std::runtime_error("persistent_arena: unsupported format version in " + path_);
+
+            if (h.schema != schema)
+                throw std::runtime_error("persistent_arena: schema version mismatch in " + path_);
+
+            if (capacity && h.capacity != capacity)
+                throw std::runtime_error("persistent_arena: capacity mismatch in " + path_);
+
+            if (h.file_size != len_ || h.used > h.capacity || h.data_offset + sizeof_mem<Ts...>(h.capacity) > len_)
+                throw std::runtime_error("persistent_arena: truncated file " + path_);
+
+            header expected = h;
+            describe(expected, std::integral_constant<size_t, sizeof...(Ts)-1>());
+
+            if (h.layers != sizeof...(Ts) ||
+                std::memcmp(h.size, expected.size, sizeof(h.size)) != 0 ||
+                std::memcmp(h.align, expected.align, sizeof(h.align)) != 0)
+                throw std::runtime_error("persistent_arena: layout mismatch in " + path_);
+        }
+
+        // size and alignment of the layer types
+        //
+
+        static void
+        describe(header &h, std::integral_constant<size_t, 0>)
+        {
+            describe_layer<0>(h);
+        }
+
+        template <size_t N>
+        static void
+        describe(header &h, std::integral_constant<size_t, N>)
+        {
+            describe_layer<N>(h);
+            describe(h, std::integral_constant<size_t, N-1>());
+        }
+
+        template <size_t N>
+        static void
+        describe_layer(header &h)
+        {
+            typedef details::layer_traits_at<N, Ts...> traits;
+            h.size[N]  = sizeof(typename traits::type);
+            h.align[N] = traits::alignment;
+        }
+
+        // offsets of the layers in the arena: recorded on creation, checked
+        // on reopen
+        //
+
+        void
+        check_offsets(char *data, std::integral_constant<size_t, 0>)
+        {
+            check_offset<0>(data);
+        }
+
+        template <size_t N>
+        void
+        check_offsets(char *data, std::integral_constant<size_t, N>)
+        {
+            check_offset<N>(data);
+            check_offsets(data, std::integral_constant<size_t, N-1>());
+        }
+
+        template <size_t N>
+        void
+        check_offset(char *data)
+        {
+            auto off = static_cast<uint64_t>(reinterpret_cast<char *>(manager_->template slot<N>(0)) - data);
+
+            if (!reopened_)
+                header_->offset[N] = off;
+            else if (header_->offset[N] != off)
+                throw std::runtime_error("persistent_arena: layout mismatch in " + path_);
+        }
+
+        std::string path_;
+        void  *addr_;
+        size_t len_;
+        bool   reopened_;
+        bool   clean_;
+
+        header   *header_;
+        uint64_t *live_;
+
+        std::unique_ptr<manager_type> manager_;
     };
 
 
-    ///////////////////////////////
-    // basic_slice_allocator class
+    /////////////////////////////////////////////////////////////////////////
+    // node_arena: bump allocation of small nodes (the ones of node based
+    // containers) out of chunks of arena, with the retire-when-empty
+    // semantics of the slice managers. A full chunk is retired, and it is
+    // recycled when its last node goes away. Chunks are aligned to their
+    // size (the mappings are over-mapped to that end), so the chunk of a
+    // node is found by masking its address. Nodes larger than chunk/16
+    // (or aligned to more than 64 bytes)
+    // go to malloc. Not thread-safe: nodes must be released by the thread
+    // that allocates.
+    //
 
-    template <size_t Ns, typename ...Ts>
-    struct basic_slice_allocator
+    struct node_arena
     {
-        typedef slice<Ts...> slice_type;
+        explicit node_arena(size_t chunk = 65536, allocator_options const &opt = allocator_options())
+        : opt_(opt)
+        , chunk_(chunk)
+        , max_node_(chunk / 16)
+        , current_(nullptr)
+        , cur_(nullptr)
+        , end_(nullptr)
+        , live_(nullptr)
+        , nlive_(0)
+        , cache_()
+        {
+            if (chunk < 4096 || (chunk & (chunk - 1)) != 0)
+                throw std::runtime_error("node_arena: the chunk size must be a power of 2 (at least 4096)");
 
-        basic_slice_allocator()
-        : manager_(new slice_manager<Ns, Ts...>())
-        {}
+            cache_.reserve(opt_.pool_high_watermark);
+        }
+
+        ~node_arena()
+        {
+            while (live_)
+                destroy_chunk(live_);
+            for(auto a : cache_)
+                delete a;
+        }
 
-        ~basic_slice_allocator() = default;
+        node_arena(const node_arena &) = delete;
+        node_arena& operator=(const node_arena &) = delete;
 
-        template <typename ...Xs>
-        std::shared_ptr<slice_type>
-        new_slice(Xs && ... packs)
+        void *
+        allocate(size_t bytes, size_t align)
         {
-            reset_manager();
-            auto p = manager_->alloc(std::forward<Xs>(packs)...);
-            return std::shared_ptr<slice_type>(manager_, p);
+            if (oversized(bytes, align))
+            {
+                void *p = nullptr;
+                if (posix_memalign(&p, std::max(align, sizeof(void *)), bytes) != 0)
+                    throw std::bad_alloc();
+                return p;
+            }
+
+            // a zero-byte node takes one byte: at the end of the chunk it
+            // would point to the next one
+
+            bytes = std::max<size_t>(bytes, 1);
+
+            auto p = align_up(cur_, align);
+            if (current_ == nullptr || p + bytes > end_) {
+                next_chunk();
+                p = align_up(cur_, align);
+            }
+
+            cur_ = p + bytes;
+            current_->nodes++;
+            return p;
         }
 
-        template <typename T, typename ...Xs>
-        std::shared_ptr<T>
-        new_shared(Xs && ... args)
+        void
+        deallocate(void *p, size_t bytes, size_t align) noexcept
         {
-            reset_manager();
-            auto p = manager_->alloc(std::forward_as_tuple(std::forward<Xs>(args)...));
-            return std::shared_ptr<T>(manager_, mem::get<T>(*p));
+            if (oversized(bytes, align)) {
+                free(p);
+                return;
+            }
+
+            auto c = reinterpret_cast<chunk *>(reinterpret_cast<uintptr_t>(p) & ~(chunk_ - 1));
+            if (--c->nodes != 0)
+                return;
+
+            // the current chunk is rewound, a retired one is recycled
+
+            if (c == current_)
+                cur_ = first_node(c);
+            else
+                recycle(c);
+        }
+
+        // chunks in use (the current one and the retired ones pinned by
+        // nodes) and chunks cached for reuse
+        //
+
+        size_t
+        chunks() const
+        {
+            return nlive_;
+        }
+
+        size_t
+        cached() const
+        {
+            return cache_.size();
+        }
+
+        size_t
+        chunk_size() const
+        {
+            return chunk_;
         }
 
     private:
 
-        void reset_manager()
+        // header at the beginning of every chunk
+        //
+
+        struct chunk
+        {
+            details::arena *mem;
+            size_t nodes;
+            chunk *prev;
+            chunk *next;
+        };
+
+        bool
+        oversized(size_t bytes, size_t align) const
+        {
+            return bytes > max_node_ || align > 64;
+        }
+
+        static char *
+        align_up(char *p, size_t align)
+        {
+            return reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(uintptr_t(align) - 1));
+        }
+
+        static char *
+        first_node(chunk *c)
+        {
+            return reinterpret_cast<char *>(c) + sizeof(chunk);
+        }
+
+        // retire the current chunk (released right away if empty) and
+        // take the most recently cached one, or a new one
+        //
+
+        void
+        next_chunk()
+        {
+            auto old = current_;
+            current_ = nullptr;
+
+            if (old && old->nodes == 0)
+                recycle(old);
+
+            details::arena *a;
+            if (cache_.empty())
+                a = new details::arena(chunk_, chunk_, opt_.arena);
+            else {
+                a = cache_.back();
+                cache_.pop_back();
+            }
+
+            auto c = static_cast<chunk *>(a->addr());
+            c->mem   = a;
+            c->nodes = 0;
+            c->prev  = nullptr;
+            c->next  = live_;
+            if (live_)
+                live_->prev = c;
+            live_ = c;
+            nlive_++;
+
+            current_ = c;
+            cur_     = first_node(c);
+            end_     = reinterpret_cast<char *>(c) + chunk_;
+        }
+
+        chunk *
+        unlink(chunk *c)
+        {
+            if (c->prev)
+                c->prev->next = c->next;
+            else
+                live_ = c->next;
+            if (c->next)
+                c->next->prev = c->prev;
+            nlive_--;
+            return c;
+        }
+
+        // the empty chunk goes back to the cache (trimmed when it leaves
+        // the hot window), or to the OS if the cache is full
+        //
+
+        void
+        recycle(chunk *c)
+        {
+            if (cache_.size() == opt_.pool_high_watermark) {
+                destroy_chunk(c);
+                return;
+            }
+
+            cache_.push_back(unlink(c)->mem);
+
+            if (cache_.size() > opt_.pool_low_watermark) {
+                auto a = cache_[cache_.size() - opt_.pool_low_watermark - 1];
+                details::trim_pages(a->addr(), a->size(), opt_.pool_trim);
+            }
+        }
+
+        void
+        destroy_chunk(chunk *c)
         {
-            if (manager_->size() == Ns)
-                manager_.reset(new slice_manager<Ns, Ts...>());
+            delete unlink(c)->mem;
         }
 
-        std::shared_ptr<slice_manager<Ns, Ts...>> manager_;
+        allocator_options opt_;
+        size_t chunk_;
+        size_t max_node_;
+
+        chunk *current_;
+        char  *cur_;
+        char  *end_;
+
+        chunk *live_;
+        size_t nlive_;
+
+        std::vector<details::arena *> cache_;
     };
 
 
-    template <typename ...Ts>
-    using slice_allocator = basic_slice_allocator<131072, Ts...>;
+    // standard allocator adapter of a node_arena, for node based
+    // containers (std::list, std::map, std::unordered_map...)
+    //
+
+    template <typename T>
+    struct arena_allocator
+    {
+        typedef T value_type;
+
+        template <typename U>
+        struct rebind
+        {
+            typedef arena_allocator<U> other;
+        };
+
+        explicit arena_allocator(node_arena &a) noexcept
+        : arena_(&a)
+        {}
+
+        template <typename U>
+        arena_allocator(arena_allocator<U> const &other) noexcept
+        : arena_(other.arena())
+        {}
+
+        T *
+        allocate(size_t n)
+        {
+            if (n > size_t(-1) / sizeof(T))
+                throw std::bad_alloc();
+            return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void
+        deallocate(T *p, size_t n) noexcept
+        {
+            arena_->deallocate(p, n * sizeof(T), alignof(T));
+        }
+
+        node_arena *
+        arena() const noexcept
+        {
+            return arena_;
+        }
+
+    private:
+        node_arena *arena_;
+    };
+
+    template <typename T, typename U>
+    inline bool operator==(arena_allocator<T> const &a, arena_allocator<U> const &b) noexcept
+    {
+        return a.arena() == b.arena();
+    }
+
+    template <typename T, typename U>
+    inline bool operator!=(arena_allocator<T> const &a, arena_allocator<U> const &b) noexcept
+    {
+        return a.arena() != b.arena();
+    }
+
+
+#ifdef MSLICE_HAS_PMR
+
+    // std::pmr::memory_resource over a node_arena
+    //
+
+    struct arena_resource : std::pmr::memory_resource
+    {
+        explicit arena_resource(size_t chunk = 65536, allocator_options const &opt = allocator_options())
+        : arena_(chunk, opt)
+        {}
+
+        node_arena &
+        arena()
+        {
+            return arena_;
+        }
+
+    private:
+
+        void *
+        do_allocate(size_t bytes, size_t align) override
+        {
+            return arena_.allocate(bytes, align);
+        }
+
+        void
+        do_deallocate(void *p, size_t bytes, size_t align) override
+        {
+            arena_.deallocate(p, bytes, align);
+        }
+
+        bool
+        do_is_equal(std::pmr::memory_resource const &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        node_arena arena_;
+    };
+
+#endif
 
 
 } // namespace mem
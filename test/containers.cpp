@@ -0,0 +1,189 @@
+/* Copyright (c) 2012, University of Pisa - Consorzio Nazionale Interuniversitario
+ * per le Telecomunicazioni.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of Interuniversitario per le Telecomunicazioni nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT
+ * HOLDERBE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE
+ */
+
+/*
+ * Author: Nicola Bonelli <nicola.bonelli@cnit.it>
+ */
+
+// node based containers on node arenas: a flow table (std::unordered_map)
+// and the LRU list of its flows (std::list), with a sliding window of
+// live flows. The node arena, as a std allocator and as a
+// std::pmr::memory_resource, is compared with the default allocator and
+// the standard resources. Requires C++17 for std::pmr.
+//
+
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <memory_resource>
+#include <chrono>
+
+#include <iostream>
+
+#include <mslice.hpp>
+
+
+struct flow_state
+{
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t first;
+    uint64_t last;
+};
+
+
+struct options
+{
+    unsigned seconds = 5;
+    size_t   flows   = 65536;     // live flows
+};
+
+
+template <typename Alloc, typename T>
+using rebind = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+
+// one flow in, the oldest one out
+//
+
+template <typename Map, typename List, typename Report>
+void
+run(const char *name, Map &table, List &lru, options const &opt, Report report)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto last  = start;
+
+    uint64_t n = 0, last_n = 0;
+
+    for(;;)
+    {
+        if ((n & 1023) == 0)
+        {
+            auto now = std::chrono::steady_clock::now();
+
+            if (now - last >= std::chrono::seconds(1))
+            {
+                auto secs = std::chrono::duration<double>(now - last).count();
+
+                std::cout << name << ": " << static_cast<double>(n - last_n) / secs / 1000000 << " Mflows/s";
+                report();
+                std::cout << std::endl;
+
+                last   = now;
+                last_n = n;
+
+                if (now - start >= std::chrono::seconds(opt.seconds))
+                    break;
+            }
+        }
+
+        auto key = n * 0x9e3779b97f4a7c15ULL;
+
+        table.emplace(key, flow_state{1, 64, n, n});
+        lru.push_back(key);
+
+        if (lru.size() > opt.flows)
+        {
+            table.erase(lru.front());
+            lru.pop_front();
+        }
+
+        n++;
+    }
+}
+
+
+template <typename Alloc>
+void
+run_allocator(const char *name, Alloc alloc, options const &opt)
+{
+    typedef std::unordered_map<uint64_t, flow_state, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               rebind<Alloc, std::pair<const uint64_t, flow_state>>> map_type;
+    typedef std::list<uint64_t, rebind<Alloc, uint64_t>> list_type;
+
+    map_type table(opt.flows * 2, std::hash<uint64_t>(), std::equal_to<uint64_t>(), typename map_type::allocator_type(alloc));
+    list_type lru{typename list_type::allocator_type(alloc)};
+
+    run(name, table, lru, opt, [] {});
+}
+
+
+void
+run_resource(const char *name, std::pmr::memory_resource *res, options const &opt, mem::node_arena *arena = nullptr)
+{
+    std::pmr::unordered_map<uint64_t, flow_state> table(opt.flows * 2, res);
+    std::pmr::list<uint64_t> lru(res);
+
+    run(name, table, lru, opt, [&] {
+        if (arena)
+            std::cout << ", chunks " << arena->chunks() << " (" << arena->cached() << " cached)";
+    });
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" mode [seconds] [flows]"));
+
+    const auto mode = static_cast<unsigned int>(atoi(argv[1]));
+
+    options opt;
+
+    if (argc > 2)
+        opt.seconds = static_cast<unsigned int>(atoi(argv[2]));
+    if (argc > 3)
+        opt.flows = static_cast<size_t>(atol(argv[3]));
+
+    switch(mode)
+    {
+        case 0: run_allocator("std::allocator", std::allocator<char>(), opt); break;
+        case 1: run_resource("pmr::new_delete_resource", std::pmr::new_delete_resource(), opt); break;
+        case 2: {
+            std::pmr::unsynchronized_pool_resource pool;
+            run_resource("pmr::unsynchronized_pool_resource", &pool, opt);
+        } break;
+        case 3: {
+            mem::arena_resource res;
+            run_resource("mem::arena_resource", &res, opt, &res.arena());
+        } break;
+        case 4: {
+            mem::node_arena arena;
+            run_allocator("mem::arena_allocator", mem::arena_allocator<char>(arena), opt);
+        } break;
+        default:
+            throw std::runtime_error("mode not implemented");
+    }
+
+    return 0;
+}
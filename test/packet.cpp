@@ -0,0 +1,548 @@
+/* Copyright (c) 2012, University of Pisa - Consorzio Nazionale Interuniversitario
+ * per le Telecomunicazioni.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of Interuniversitario per le Telecomunicazioni nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT
+ * HOLDERBE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE
+ */
+
+/*
+ * Author: Nicola Bonelli <nicola.bonelli@cnit.it>
+ */
+
+// packet workload: multi-layer packets (ethernet, ipv4, tcp, payload
+// snippet and flow metadata) with a configurable lifetime distribution.
+// Most packets are dropped right away, a fraction is kept for a while and
+// a long tail is kept for a Pareto-distributed time. Requires C++17 for
+// std::pmr.
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include <array>
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <chrono>
+#include <tuple>
+
+#include <iostream>
+
+#include <unistd.h>
+
+#include <mslice.hpp>
+
+
+struct eth_header
+{
+    uint8_t  dst[6];
+    uint8_t  src[6];
+    uint16_t type;
+};
+
+struct ipv4_header
+{
+    uint8_t  ver_ihl;
+    uint8_t  tos;
+    uint16_t len;
+    uint16_t id;
+    uint16_t frag;
+    uint8_t  ttl;
+    uint8_t  proto;
+    uint16_t csum;
+    uint32_t saddr;
+    uint32_t daddr;
+};
+
+struct tcp_header
+{
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t seq;
+    uint32_t ack;
+    uint16_t flags;
+    uint16_t win;
+    uint16_t csum;
+    uint16_t urg;
+};
+
+typedef std::array<uint8_t, 128> payload;
+
+struct flow_meta
+{
+    uint64_t hash;
+    uint64_t timestamp;
+    uint32_t packets;
+    uint32_t bytes;
+};
+
+
+// lifetime distribution of the packets
+//
+
+struct workload
+{
+    double   keep    = 0.02;    // fraction of packets kept for keep_ms
+    unsigned keep_ms = 100;
+    double   tail    = 0.0001;  // fraction of packets kept for a Pareto(alpha, keep_ms) time
+    double   alpha   = 1.5;
+    unsigned seconds = 5;
+};
+
+
+const unsigned horizon_ms = 30000;  // longest lifetime
+
+
+struct xorshift
+{
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+    uint64_t operator()()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    double uniform()
+    {
+        return static_cast<double>((*this)() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+
+// fill the layers as a capture would do
+//
+
+inline void
+fill(eth_header &eth, ipv4_header &ip, tcp_header &tcp, payload &data, flow_meta &meta, uint64_t n)
+{
+    std::memset(&eth, 0xff, sizeof(eth));
+    eth.type = 0x0008;
+
+    ip.ver_ihl = 0x45;
+    ip.tos     = 0;
+    ip.len     = 1500;
+    ip.id      = static_cast<uint16_t>(n);
+    ip.frag    = 0;
+    ip.ttl     = 64;
+    ip.proto   = 6;
+    ip.csum    = 0;
+    ip.saddr   = static_cast<uint32_t>(n * 2654435761ULL);
+    ip.daddr   = 0x0a000001;
+
+    tcp.sport  = static_cast<uint16_t>(n >> 16);
+    tcp.dport  = 80;
+    tcp.seq    = static_cast<uint32_t>(n);
+    tcp.ack    = 0;
+    tcp.flags  = 0x18;
+    tcp.win    = 65535;
+    tcp.csum   = 0;
+    tcp.urg    = 0;
+
+    std::memset(data.data(), static_cast<int>(n & 0xff), 64);
+
+    meta.hash      = ip.saddr ^ (uint64_t(tcp.sport) << 32);
+    meta.timestamp = n;
+    meta.packets   = 1;
+    meta.bytes     = ip.len;
+}
+
+
+// packet handles
+//
+
+struct malloc_packet
+{
+    std::unique_ptr<eth_header>  eth;
+    std::unique_ptr<ipv4_header> ip;
+    std::unique_ptr<tcp_header>  tcp;
+    std::unique_ptr<payload>     data;
+    std::unique_ptr<flow_meta>   meta;
+};
+
+struct shared_packet
+{
+    std::shared_ptr<eth_header>  eth;
+    std::shared_ptr<ipv4_header> ip;
+    std::shared_ptr<tcp_header>  tcp;
+    std::shared_ptr<payload>     data;
+    std::shared_ptr<flow_meta>   meta;
+};
+
+struct pmr_packet
+{
+    pmr_packet() = default;
+
+    pmr_packet(std::pmr::memory_resource *r)
+    : res(r)
+    , eth(make<eth_header>())
+    , ip(make<ipv4_header>())
+    , tcp(make<tcp_header>())
+    , data(make<payload>())
+    , meta(make<flow_meta>())
+    {}
+
+    pmr_packet(pmr_packet &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    pmr_packet& operator=(pmr_packet &&other) noexcept
+    {
+        std::swap(res, other.res);
+        std::swap(eth, other.eth);
+        std::swap(ip, other.ip);
+        std::swap(tcp, other.tcp);
+        std::swap(data, other.data);
+        std::swap(meta, other.meta);
+        return *this;
+    }
+
+    ~pmr_packet()
+    {
+        if (res == nullptr)
+            return;
+        res->deallocate(eth, sizeof(*eth), alignof(eth_header));
+        res->deallocate(ip, sizeof(*ip), alignof(ipv4_header));
+        res->deallocate(tcp, sizeof(*tcp), alignof(tcp_header));
+        res->deallocate(data, sizeof(*data), alignof(payload));
+        res->deallocate(meta, sizeof(*meta), alignof(flow_meta));
+    }
+
+    template <typename T>
+    T *make()
+    {
+        return new (res->allocate(sizeof(T), alignof(T))) T;
+    }
+
+    std::pmr::memory_resource *res = nullptr;
+
+    eth_header  *eth  = nullptr;
+    ipv4_header *ip   = nullptr;
+    tcp_header  *tcp  = nullptr;
+    payload     *data = nullptr;
+    flow_meta   *meta = nullptr;
+};
+
+
+// packet allocators: return a packet with its layers filled
+//
+
+struct malloc_allocator
+{
+    typedef malloc_packet packet_type;
+
+    packet_type
+    operator()(uint64_t n)
+    {
+        packet_type p { std::unique_ptr<eth_header>(new eth_header), std::unique_ptr<ipv4_header>(new ipv4_header),
+                        std::unique_ptr<tcp_header>(new tcp_header), std::unique_ptr<payload>(new payload),
+                        std::unique_ptr<flow_meta>(new flow_meta) };
+        fill(*p.eth, *p.ip, *p.tcp, *p.data, *p.meta, n);
+        return p;
+    }
+
+    size_t live_arena() const { return 0; }
+    size_t pinned_arena() const { return 0; }
+};
+
+struct shared_allocator
+{
+    typedef shared_packet packet_type;
+
+    packet_type
+    operator()(uint64_t n)
+    {
+        packet_type p { std::make_shared<eth_header>(), std::make_shared<ipv4_header>(), std::make_shared<tcp_header>(),
+                        std::make_shared<payload>(), std::make_shared<flow_meta>() };
+        fill(*p.eth, *p.ip, *p.tcp, *p.data, *p.meta, n);
+        return p;
+    }
+
+    size_t live_arena() const { return 0; }
+    size_t pinned_arena() const { return 0; }
+};
+
+struct pmr_allocator
+{
+    typedef pmr_packet packet_type;
+
+    packet_type
+    operator()(uint64_t n)
+    {
+        packet_type p(&pool);
+        fill(*p.eth, *p.ip, *p.tcp, *p.data, *p.meta, n);
+        return p;
+    }
+
+    size_t live_arena() const { return 0; }
+    size_t pinned_arena() const { return 0; }
+
+    std::pmr::unsynchronized_pool_resource pool;
+};
+
+const size_t slots = 4096;
+
+
+// arena bytes of the retired managers actually pinned by packets
+//
+
+template <typename Alloc>
+size_t
+pinned_bytes(Alloc const &alloc)
+{
+    size_t bytes = 0;
+    for(auto &m : alloc.pinned())
+        bytes += m.arena_bytes;
+    return bytes;
+}
+
+
+template <typename Policy>
+struct mslice_allocator
+{
+    typedef mem::policy_slice_allocator<Policy, slots,
+                mem::uninitialized<eth_header>, mem::uninitialized<ipv4_header>, mem::uninitialized<tcp_header>,
+                mem::uninitialized<payload>, mem::uninitialized<flow_meta>> allocator_type;
+
+    typedef typename allocator_type::template pointer<typename allocator_type::slice_type> packet_type;
+
+    packet_type
+    operator()(uint64_t n)
+    {
+        auto p = alloc.new_slice(mem::none, mem::none, mem::none, mem::none, mem::none);
+        fill(*mem::get<0>(p), *mem::get<1>(p), *mem::get<2>(p), *mem::get<3>(p), *mem::get<4>(p), n);
+        return p;
+    }
+
+    // arena bytes of the live managers, and of the retired ones still
+    // pinned by packets (measured by the pinned() diagnostics)
+    //
+
+    size_t live_arena()
+    {
+        return alloc.stats().live_managers * arena_size();
+    }
+
+    size_t pinned_arena()
+    {
+        return pinned_bytes(alloc);
+    }
+
+    static size_t arena_size()
+    {
+        return mem::sizeof_mem<slots, mem::uninitialized<eth_header>, mem::uninitialized<ipv4_header>, mem::uninitialized<tcp_header>,
+                               mem::uninitialized<payload>, mem::uninitialized<flow_meta>>();
+    }
+
+    allocator_type alloc;
+};
+
+
+// variable-length payloads carved from the secondary region of the
+// managers (size classes 128/512/2048/9216): 60% small, 25% medium and
+// 15% full-size frames
+//
+
+template <typename Policy>
+struct mslice_region_allocator
+{
+    typedef mem::policy_slice_allocator<Policy, slots,
+                mem::uninitialized<eth_header>, mem::uninitialized<ipv4_header>, mem::uninitialized<tcp_header>,
+                mem::packet_bytes, mem::uninitialized<flow_meta>> allocator_type;
+
+    typedef typename allocator_type::template pointer<typename allocator_type::slice_type> packet_type;
+
+    static const size_t region = 1024 * slots;
+
+    static mem::allocator_options
+    options()
+    {
+        mem::allocator_options opt;
+        opt.region_bytes = region;
+        return opt;
+    }
+
+    mslice_region_allocator()
+    : alloc(options())
+    {}
+
+    packet_type
+    operator()(uint64_t n)
+    {
+        auto h   = (n * 0x9e3779b97f4a7c15ULL) >> 57;
+        auto len = h < 77 ? 64 : h < 109 ? 576 : 1460;
+
+        auto p = alloc.new_slice(mem::none, mem::none, mem::none, std::make_tuple(len), mem::none);
+        fill(*mem::get<0>(p), *mem::get<1>(p), *mem::get<2>(p), *reinterpret_cast<payload *>(mem::get<3>(p)->data()), *mem::get<4>(p), n);
+        return p;
+    }
+
+    size_t live_arena()
+    {
+        return alloc.stats().live_managers * arena_size();
+    }
+
+    size_t pinned_arena()
+    {
+        return pinned_bytes(alloc);
+    }
+
+    static size_t arena_size()
+    {
+        return mem::sizeof_mem<slots, mem::uninitialized<eth_header>, mem::uninitialized<ipv4_header>, mem::uninitialized<tcp_header>,
+                               mem::packet_bytes, mem::uninitialized<flow_meta>>() + region;
+    }
+
+    allocator_type alloc;
+};
+
+
+inline double
+rss_mb()
+{
+    long pages = 0, resident = 0;
+
+    if (FILE *f = fopen("/proc/self/statm", "r"))
+    {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+
+    return static_cast<double>(resident) * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024 * 1024);
+}
+
+
+// run the workload: packets are held in a timing wheel with 1 ms slots
+//
+
+template <typename Alloc>
+void
+run(const char *name, workload const &w)
+{
+    typedef typename Alloc::packet_type packet_type;
+
+    Alloc allocator;
+    xorshift rnd;
+
+    std::vector<std::vector<packet_type>> wheel(horizon_ms);
+
+    auto start = std::chrono::steady_clock::now();
+    auto last  = start;
+
+    uint64_t n = 0, last_n = 0;
+    size_t   now_ms = 0, cur_ms = 0;
+
+    for(;;)
+    {
+        // the clock is sampled every 256 packets
+
+        if ((n & 255) == 0)
+        {
+            auto now = std::chrono::steady_clock::now();
+            now_ms   = static_cast<size_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count());
+
+            for(; cur_ms < now_ms; cur_ms++)
+                wheel[cur_ms % horizon_ms].clear();
+
+            if (now - last >= std::chrono::seconds(1))
+            {
+                auto secs = std::chrono::duration<double>(now - last).count();
+
+                std::cout << name << ": " << static_cast<double>(n - last_n) / secs / 1000000 << " Mpps, "
+                          << "rss " << rss_mb() << " MB, "
+                          << "arena " << static_cast<double>(allocator.live_arena()) / (1024 * 1024) << " MB, "
+                          << "pinned " << static_cast<double>(allocator.pinned_arena()) / (1024 * 1024) << " MB" << std::endl;
+
+                last   = now;
+                last_n = n;
+
+                if (now - start >= std::chrono::seconds(w.seconds))
+                    break;
+            }
+        }
+
+        auto p = allocator(n++);
+        auto u = rnd.uniform();
+
+        if (u < w.keep)
+        {
+            wheel[(now_ms + w.keep_ms) % horizon_ms].push_back(std::move(p));
+        }
+        else if (u < w.keep + w.tail)
+        {
+            auto life = static_cast<double>(w.keep_ms) / std::pow(1.0 - rnd.uniform(), 1.0 / w.alpha);
+            auto ms   = std::min(static_cast<size_t>(life), static_cast<size_t>(horizon_ms - 1));
+
+            wheel[(now_ms + ms) % horizon_ms].push_back(std::move(p));
+        }
+    }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" mode [seconds] [keep keep_ms] [tail alpha]"));
+
+    const auto mode = static_cast<unsigned int>(atoi(argv[1]));
+
+    workload w;
+
+    if (argc > 2)
+        w.seconds = static_cast<unsigned int>(atoi(argv[2]));
+    if (argc > 4) {
+        w.keep    = atof(argv[3]);
+        w.keep_ms = static_cast<unsigned int>(atoi(argv[4]));
+    }
+    if (argc > 6) {
+        w.tail  = atof(argv[5]);
+        w.alpha = atof(argv[6]);
+    }
+
+    if (w.keep_ms >= horizon_ms)
+        throw std::runtime_error("keep_ms too large");
+
+    switch(mode)
+    {
+        case 0: run<malloc_allocator>("malloc", w); break;
+        case 1: run<shared_allocator>("make_shared", w); break;
+        case 2: run<pmr_allocator>("pmr::unsynchronized_pool_resource", w); break;
+        case 3: run<mslice_allocator<mem::shared_refcount>>("slice_allocator", w); break;
+        case 4: run<mslice_allocator<mem::local_refcount>>("slice_allocator+local_refcount", w); break;
+        case 5: run<mslice_region_allocator<mem::shared_refcount>>("slice_allocator+packet_bytes", w); break;
+        default:
+            throw std::runtime_error("mode not implemented");
+    }
+
+    return 0;
+}
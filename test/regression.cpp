@@ -1,5 +1,17 @@
+// built with and without MSLICE_STATS and MSLICE_DIAGNOSTICS (see
+// CMakeLists.txt)
+//
+
 #include <mslice.hpp>
 
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
 #include <yats.hpp>
 
 using namespace yats;
@@ -88,6 +100,1241 @@ Context(mslice)
         Assert( *s3 == 3);
         Assert( *s4 == 4);
     }
+
+    struct counted
+    {
+        counted(int v = 0)
+        : value_(v)
+        { alive++; }
+
+        ~counted()
+        { alive--; }
+
+        int value_;
+        static int alive;
+    };
+
+    int counted::alive = 0;
+
+    Test(local_refcount)
+    {
+        {
+            mem::policy_slice_allocator<mem::local_refcount, 2, counted> alloc;
+
+            auto s1 = alloc.new_slice(std::forward_as_tuple(1));
+            auto s2 = alloc.new_shared<counted>(2);
+            auto s3 = alloc.new_shared<counted>(3);
+            auto c1 = s1;
+
+            Assert( mem::get<0>(c1)->value_ == 1 );
+            Assert( s2->value_ == 2 );
+            Assert( s3->value_ == 3 );
+
+            s1.reset();
+            c1.reset();
+            Assert( counted::alive == 3 );
+
+            s2.reset();
+
+            Assert( counted::alive == 1 );
+            Assert( !s1 );
+        }
+
+        Assert( counted::alive == 0 );
+    }
+
+    Test(unique_refcount)
+    {
+        mem::policy_slice_allocator<mem::unique_refcount, 2, counted> alloc;
+
+        auto s1 = alloc.new_shared<counted>(1);
+        auto s2 = alloc.new_shared<counted>(2);
+        auto s3 = alloc.new_slice(std::forward_as_tuple(3));
+
+        Assert( counted::alive == 3 );
+
+        auto m1 = std::move(s1);
+        Assert( !s1 );
+        Assert( m1->value_ == 1 );
+        Assert( mem::get<counted>(s3)->value_ == 3 );
+
+        m1.reset();
+        s2.reset();
+
+        Assert( counted::alive == 1 );
+    }
+
+    Test(manager_pool)
+    {
+        mem::allocator_options opt;
+        opt.pool_low_watermark  = 1;
+        opt.pool_high_watermark = 2;
+
+        mem::policy_slice_allocator<mem::local_refcount, 2, counted> alloc(opt);
+
+        auto s1 = alloc.new_shared<counted>(1);
+        auto p1 = s1.get();
+        auto s2 = alloc.new_shared<counted>(2);
+
+        s1.reset();
+        s2.reset();
+
+        Assert( alloc.pool_size() == 0 );
+
+        // the first manager is unpinned: it is recycled at rollover
+
+        auto s3 = alloc.new_shared<counted>(3);
+
+        Assert( s3.get() == p1 );
+        Assert( s3->value_ == 3 );
+        Assert( counted::alive == 1 );
+
+        // pinned managers are cached when the last slice goes away
+
+        auto s4 = alloc.new_shared<counted>(4);
+        auto s5 = alloc.new_shared<counted>(5);
+        auto s6 = alloc.new_shared<counted>(6);
+
+        s3.reset();
+        s4.reset();
+
+        Assert( alloc.pool_size() == 1 );
+        Assert( counted::alive == 2 );
+
+        s5.reset();
+        s6.reset();
+        auto s7 = alloc.new_shared<counted>(7);
+        auto s8 = alloc.new_shared<counted>(8);
+        auto s9 = alloc.new_shared<counted>(9);
+
+        Assert( s9.get() == p1 );
+        Assert( alloc.pool_size() == 0 );
+    }
+
+    Test(arena_backing)
+    {
+        const mem::arena_backing backing[] = { mem::arena_backing::heap, mem::arena_backing::mmap, mem::arena_backing::transparent,
+                                               mem::arena_backing::huge_2m, mem::arena_backing::huge_1g };
+
+        for(auto b : backing)
+        {
+            mem::allocator_options opt;
+            opt.arena.backing  = b;
+            opt.arena.prefault = true;
+
+            mem::basic_slice_allocator<1024, int, std::string> alloc(opt);
+
+            // huge pages may not be available: the backing falls back to smaller pages
+
+            Assert( alloc.backing() <= b );
+            Assert( (b == mem::arena_backing::heap) == (alloc.backing() == mem::arena_backing::heap) );
+
+            std::vector<std::shared_ptr<mem::slice<int, std::string>>> v;
+            for(int i = 0; i < 3000; i++)
+                v.push_back(alloc.new_slice(std::forward_as_tuple(i), std::forward_as_tuple("x")));
+
+            Assert( *mem::get<0>(v[2999]) == 2999 );
+            Assert( *mem::get<1>(v[2999]) == "x" );
+        }
+    }
+
+    Test(new_slices)
+    {
+        mem::policy_slice_allocator<mem::local_refcount, 8, counted, std::string> alloc;
+
+        auto s0 = alloc.new_slice(std::forward_as_tuple(0), mem::none);
+
+        {
+            auto b = alloc.new_slices(3, std::forward_as_tuple(7), std::forward_as_tuple("abc"));
+
+            Assert( b.size() == 3 );
+            Assert( b.runs() == 1 );
+            Assert( b.get_run(0).data + 1 == &b[1] );
+
+            int n = 0;
+            for(auto & s : b)
+            {
+                Assert( mem::get<0>(s)->value_ == 7 );
+                Assert( *mem::get<1>(s) == "abc" );
+                n++;
+            }
+            Assert( n == 3 );
+        }
+
+        // across the manager boundary: two runs
+
+        auto b = alloc.new_slices(6, mem::none, std::forward_as_tuple("x"));
+
+        Assert( b.size() == 6 );
+        Assert( b.runs() == 2 );
+        Assert( b.get_run(0).size == 4 );
+        Assert( b.get_run(1).size == 2 );
+        Assert( *mem::get<1>(b[5]) == "x" );
+
+        auto s5 = b.share(5);
+        s0.reset();
+        b.reset();
+
+        Assert( b.empty() );
+        Assert( *mem::get<1>(s5) == "x" );
+        Assert( counted::alive == 2 );
+
+        AssertThrow( alloc.new_slices(9, mem::none, mem::none) );
+    }
+
+    Test(concurrent_release)
+    {
+        // slices dropped by another thread while the allocator walks the
+        // live managers: a manager is cleared only once it is no longer
+        // visited
+
+        mem::basic_slice_allocator<16, int, std::string> alloc;
+
+        std::vector<std::shared_ptr<mem::slice<int, std::string>>> v;
+
+        for(int i = 0; i < 16 * 512; i++)
+            v.push_back(alloc.new_slice(std::forward_as_tuple(i), std::forward_as_tuple("a string longer than the small buffer")));
+
+        std::atomic<bool> finished(false);
+
+        std::thread worker([&]
+        {
+            for(auto &s : v)
+                s.reset();
+            finished.store(true);
+        });
+
+        size_t bad = 0;
+
+        while (!finished.load())
+        {
+            alloc.for_each_layer<1>([&](mem::layer_view<std::string> const &view)
+            {
+                for(size_t i = 0; i < view.size; i++)
+                    bad += view.is_live(i) && view[i].size() != 37;
+            });
+        }
+
+        worker.join();
+
+        Assert( bad == 0 );
+        Assert( alloc.stats().live_managers == 1 );
+    }
+
+
+    Test(sweep_in_for_each_layer)
+    {
+        // the callback of for_each_layer may drop the last handles of a
+        // manager and allocate (rollover included), as a sweep does
+
+        mem::policy_slice_allocator<mem::local_refcount, 4, int> alloc;
+
+        std::vector<mem::local_ptr<mem::slice<int>>> v;
+        for(int i = 0; i < 12; i++)
+            v.push_back(alloc.new_slice(std::forward_as_tuple(i)));
+
+        size_t visited = 0, sum = 0;
+
+        alloc.for_each_layer<int>([&](mem::layer_view<int> const &view)
+        {
+            visited++;
+            for(size_t i = 0; i < view.size; i++)
+                sum += static_cast<size_t>(view[i]);
+
+            v.clear();
+            for(int i = 0; i < 5; i++)
+                v.push_back(alloc.new_slice(std::forward_as_tuple(100)));
+        });
+
+        Assert( visited == 3 );
+        Assert( sum == 66 );
+        Assert( alloc.pinned().size() == 1 );
+
+        v.clear();
+        Assert( alloc.pinned().empty() );
+    }
+
+
+    Test(layer_views)
+    {
+        mem::basic_slice_allocator<100, int, std::string> alloc;
+
+        std::vector<std::shared_ptr<mem::slice<int, std::string>>> v;
+
+        for(int i = 0; i < 130; i++)
+            v.push_back(alloc.new_slice(std::forward_as_tuple(i), mem::none));
+
+        Assert( alloc.stats().live_managers == 2 );
+
+        size_t managers = 0, slots = 0;
+        long sum = 0;
+
+        alloc.for_each_layer<int>([&](mem::layer_view<int> const &view)
+        {
+            managers++;
+            slots += view.size;
+
+            for(size_t w = 0; w < view.words(); w++)
+                for(uint64_t bits = view.live[w]; bits != 0; bits &= bits - 1)
+                    sum += view[w * 64 + static_cast<size_t>(__builtin_ctzll(bits))];
+        });
+
+        Assert( managers == 2 );
+        Assert( slots == 130 );
+        Assert( sum == 129 * 130 / 2 );
+
+        // the retired manager is no longer visited when its slices are gone
+
+        v.erase(v.begin(), v.begin() + 100);
+
+        managers = 0;
+        alloc.for_each_layer<1>([&](mem::layer_view<std::string> const &view)
+        {
+            managers++;
+            Assert( view.size == 30 );
+            Assert( view.is_live(29) );
+            Assert( !view.is_live(30) );
+        });
+
+        Assert( managers == 1 );
+        Assert( alloc.stats().live_managers == 1 );
+    }
+
+    Test(remote_free)
+    {
+        mem::policy_slice_allocator<mem::local_refcount, 4, counted> alloc;
+        mem::remote_free_queue queue(4);
+
+        std::vector<mem::local_ptr<counted>> v;
+        for(int i = 0; i < 8; i++)
+            v.push_back(alloc.new_shared<counted>(i));
+
+        alloc.new_shared<counted>(8);
+
+        std::thread consumer([&]
+        {
+            for(auto & p : v)
+                queue.push(std::move(p));
+        });
+
+        size_t n = 0;
+        while (n < 8)
+            n += queue.drain();
+
+        consumer.join();
+
+        // the two managers filled by v are released
+
+        Assert( counted::alive == 1 );
+        Assert( queue.drain() == 0 );
+    }
+
+    Test(concurrent_allocator)
+    {
+        mem::basic_concurrent_slice_allocator<16, int> alloc;
+
+        std::vector<std::shared_ptr<int>> v[4];
+        std::vector<std::thread> ts;
+
+        for(int t = 0; t < 4; t++)
+            ts.emplace_back([&, t]
+            {
+                for(int i = 0; i < 100; i++)
+                    v[t].push_back(alloc.new_shared<int>(t * 1000 + i));
+            });
+
+        for(auto & t : ts)
+            t.join();
+
+        // the allocators of the exited threads are gone, their slices
+        // keep the managers
+
+        Assert( alloc.threads() == 0 );
+
+        for(int t = 0; t < 4; t++)
+            for(int i = 0; i < 100; i++)
+                Assert( *v[t][static_cast<size_t>(i)] == t * 1000 + i );
+
+        // handles are released by a thread other than the allocating one
+
+        auto s = alloc.new_shared<int>(42);
+        Assert( alloc.threads() == 1 );
+        Assert( *s == 42 );
+
+        for(auto & x : v)
+            x.clear();
+
+        // thread churn does not accumulate allocators
+
+        for(int t = 0; t < 32; t++)
+            std::thread([&] { alloc.new_shared<int>(t); }).join();
+
+        Assert( alloc.threads() == 1 );
+
+        // a thread may outlive the instance
+
+        std::unique_ptr<mem::basic_concurrent_slice_allocator<16, int>> gone(new mem::basic_concurrent_slice_allocator<16, int>());
+        std::atomic<int> step(0);
+
+        std::thread late([&]
+        {
+            auto p = gone->new_shared<int>(7);
+            step.store(1);
+            while (step.load() != 2)
+                std::this_thread::yield();
+            Assert( *p == 7 );
+        });
+
+        while (step.load() != 1)
+            std::this_thread::yield();
+
+        gone.reset();
+        step.store(2);
+        late.join();
+    }
+
+    struct alignas(32) vec8
+    {
+        float value[8];
+    };
+
+    template <typename T>
+    bool is_aligned(T const *p, size_t align)
+    {
+        return (reinterpret_cast<uintptr_t>(p) % align) == 0;
+    }
+
+    Test(aligned_layers)
+    {
+        mem::basic_slice_allocator<7, std::array<char, 5>, vec8, mem::cache_aligned<int>, mem::aligned<char, 32>> alloc;
+
+        for(int i = 0; i < 7; i++)
+        {
+            auto s = alloc.new_slice(mem::none, mem::none, std::forward_as_tuple(i), mem::none);
+
+            Assert( is_aligned(mem::get<1>(s), 32) );
+            Assert( *mem::get<int>(s) == i );
+
+            if (i == 0)
+            {
+                Assert( is_aligned(mem::get<2>(s), 64) );
+                Assert( is_aligned(mem::get<3>(s), 32) );
+            }
+        }
+
+        Assert( mem::sizeof_mem<7, std::array<char, 5>, vec8>() == 64 + 7 * 32 );
+        Assert( mem::sizeof_mem<7, char, mem::cache_aligned<int>>() == 64 + 7 * 4 );
+    }
+
+    Test(numa_placement)
+    {
+        mem::allocator_options opt;
+        opt.arena.backing = mem::arena_backing::mmap;
+        opt.arena.numa = mem::numa_placement::local;
+
+        mem::basic_slice_allocator<1024, int> local(opt);
+
+        auto s1 = local.new_shared<int>(1);
+        auto st = local.stats();
+
+        Assert( st.numa_node == mem::details::current_numa_node() || st.numa_node == -1 );
+        Assert( st.numa_node == -1 || st.numa_resident_node == st.numa_node );
+
+        // a node that does not exist leaves the arena unbound
+
+        opt.arena.numa = mem::numa_placement::node;
+        opt.arena.numa_node = 1000;
+
+        mem::basic_slice_allocator<1024, int> missing(opt);
+
+        auto s2 = missing.new_shared<int>(2);
+
+        Assert( missing.stats().numa_node == -1 );
+        Assert( *s2 == 2 );
+
+        // ...unless the placement is strict
+
+        opt.arena.numa_strict = true;
+        AssertThrow( (mem::basic_slice_allocator<1024, int>(opt)) );
+
+        // the policy is never applied to the heap
+
+        opt.arena.backing = mem::arena_backing::heap;
+        opt.arena.numa = mem::numa_placement::local;
+        opt.arena.numa_strict = false;
+
+        mem::basic_slice_allocator<1024, int> heap(opt);
+        Assert( heap.backing() == mem::arena_backing::mmap );
+    }
+
+
+    Test(lazy_layers)
+    {
+        counted::alive = 0;
+        {
+            mem::basic_slice_allocator<4, int, mem::lazy<std::string>, mem::lazy<counted>> alloc;
+
+            auto s = alloc.new_slice(std::forward_as_tuple(1), mem::none, mem::none);
+
+            Assert( mem::has<0>(s) );
+            Assert( !mem::has<std::string>(s) );
+            Assert( !mem::has<counted>(s) );
+            Assert( counted::alive == 0 );
+
+            Assert( *mem::emplace<std::string>(s, "hello") == "hello" );
+            Assert( mem::has<1>(s) );
+
+            mem::emplace<2>(s, 1);
+            mem::emplace<2>(s, 2);
+
+            Assert( counted::alive == 1 );
+            Assert( mem::get<counted>(s)->value_ == 2 );
+
+            // a non-empty pack constructs the lazy layer at allocation
+
+            auto t = alloc.new_slice(std::forward_as_tuple(2), std::forward_as_tuple("world"), mem::none);
+
+            Assert( mem::has<1>(t) );
+            Assert( !mem::has<2>(t) );
+
+            alloc.for_each_layer<counted>([&](mem::layer_view<counted> const &v) {
+                Assert( v.is_present(0) );
+                Assert( !v.is_present(1) );
+            });
+        }
+        Assert( counted::alive == 0 );
+    }
+
+
+    Test(construction_policies)
+    {
+        typedef std::array<int, 4> header;
+
+        mem::basic_slice_allocator<4, mem::uninitialized<header>, mem::prototyped<header>, counted> alloc;
+
+        // without a prototype, prototyped layers are value-initialized
+
+        auto s0 = alloc.new_slice(mem::none, mem::none, mem::none);
+
+        Assert( (*mem::get<1>(s0))[3] == 0 );
+
+        alloc.prototype<1>(header{{1, 2, 3, 4}});
+
+        std::vector<std::shared_ptr<mem::slice<mem::uninitialized<header>, mem::prototyped<header>, counted>>> v;
+
+        for(int i = 0; i < 6; i++)
+            v.push_back(alloc.new_slice(mem::none, mem::none, std::forward_as_tuple(i)));
+
+        for(auto &s : v)
+        {
+            Assert( (*mem::get<1>(s))[0] == 1 );
+            Assert( (*mem::get<1>(s))[3] == 4 );
+        }
+
+        Assert( mem::get<counted>(v[5])->value_ == 5 );
+
+        // explicit packs still take precedence over the policy
+
+        auto s1 = alloc.new_slice(std::forward_as_tuple(header{{7, 7, 7, 7}}), std::forward_as_tuple(header{{8, 8, 8, 8}}), mem::none);
+
+        Assert( (*mem::get<0>(s1))[0] == 7 );
+        Assert( (*mem::get<1>(s1))[0] == 8 );
+    }
+
+
+    Test(slice_ref)
+    {
+        counted::alive = 0;
+        {
+            mem::policy_slice_allocator<mem::local_refcount, 4, int, mem::lazy<counted>> alloc;
+
+            std::vector<mem::slice_ref<mem::slice_manager<4, int, mem::lazy<counted>>>> v;
+
+            for(int i = 0; i < 6; i++)
+                v.push_back(alloc.new_slice_ref(std::forward_as_tuple(i), mem::none));
+
+            Assert( sizeof(v[0]) <= 16 );
+
+            for(int i = 0; i < 6; i++)
+                Assert( *mem::get<0>(v[static_cast<size_t>(i)]) == i );
+
+            Assert( v[4].index() == 0 );
+            Assert( v[4].manager() != v[0].manager() );
+
+            Assert( !mem::has<counted>(v[1]) );
+            Assert( mem::emplace<counted>(v[1], 42)->value_ == 42 );
+            Assert( mem::has<1>(v[1]) );
+            Assert( mem::get<counted>(v[1])->value_ == 42 );
+            Assert( counted::alive == 1 );
+
+            // the first manager is retired, the handles keep it alive
+
+            v.erase(v.begin() + 2, v.end());
+
+            Assert( *mem::get<int>(v[1]) == 1 );
+        }
+        Assert( counted::alive == 0 );
+    }
+
+
+    Test(slot_recycling)
+    {
+        counted::alive = 0;
+        {
+            mem::allocator_options opt;
+            opt.recycle = true;
+
+            mem::policy_slice_allocator<mem::local_refcount, 4, int, mem::lazy<counted>> alloc(opt);
+
+            typedef mem::slice_ref<mem::slice_manager<4, int, mem::lazy<counted>>> ref_type;
+
+            std::vector<ref_type> v;
+
+            for(int i = 0; i < 4; i++) {
+                v.push_back(alloc.new_slice_ref(std::forward_as_tuple(i), mem::none));
+                mem::emplace<counted>(v.back(), i);
+            }
+
+            Assert( sizeof(v[0]) <= 16 );
+            Assert( counted::alive == 4 );
+
+            auto m     = v[2].manager();
+            auto stale = v[2];
+
+            mem::recycle(v[2]);
+
+            Assert( !v[2] );
+            Assert( !mem::valid(stale) );
+            Assert( mem::valid(v[1]) );
+            Assert( counted::alive == 3 );
+            Assert( m->free_slots() == 1 );
+            Assert( !m->layer<int>().is_live(2) );
+
+            // a stale handle cannot recycle the slot again
+
+            AssertThrow( mem::recycle(stale) );
+
+            // the full manager reuses the slot instead of rolling over
+
+            auto r = alloc.new_slice_ref(std::forward_as_tuple(42), mem::none);
+
+            Assert( r.manager() == m );
+            Assert( r.index() == 2 );
+            Assert( r.generation() != stale.generation() );
+            Assert( *mem::get<int>(r) == 42 );
+            Assert( !mem::has<counted>(r) );
+            Assert( m->layer<int>().is_live(2) );
+            Assert( m->free_slots() == 0 );
+            Assert( !mem::valid(stale) );
+
+            auto n = alloc.new_slice_ref(std::forward_as_tuple(5), mem::none);
+            Assert( n.manager() != m );
+
+            // recycled slots are not destroyed twice with the manager
+
+            mem::recycle(v[0]);
+            Assert( counted::alive == 2 );
+        }
+        Assert( counted::alive == 0 );
+
+        // without the option, slots are not recycled
+
+        mem::policy_slice_allocator<mem::local_refcount, 4, int> plain;
+
+        auto r = plain.new_slice_ref(std::forward_as_tuple(1));
+        Assert( mem::valid(r) && r.generation() == 0 );
+        AssertThrow( mem::recycle(r) );
+    }
+
+
+    Test(standby_manager)
+    {
+        mem::allocator_options opt;
+        opt.standby = mem::standby_mode::incremental;
+
+        {
+            mem::basic_slice_allocator<4, int> alloc(opt);
+
+            auto s = alloc.new_shared<int>(0);
+
+            // the standby is provisioned ahead of the rollover, off the
+            // live managers
+
+            Assert( alloc.stats().live_managers == 1 );
+            Assert( alloc.stats().standby_managers == 1 );
+            Assert( alloc.pinned().empty() );
+
+            std::vector<std::shared_ptr<int>> v;
+            for(int i = 0; i < 10; i++)
+                v.push_back(alloc.new_shared<int>(i));
+
+            for(int i = 0; i < 10; i++)
+                Assert( *v[static_cast<size_t>(i)] == i );
+
+            // the standby has become the current manager at the rollovers
+
+            Assert( alloc.stats().live_managers == 3 );
+            Assert( alloc.stats().standby_managers == 1 );
+        }
+
+        // with recycling the size of the current manager stays put: the
+        // standby is provisioned once per step
+
+        opt.recycle = true;
+
+        {
+            mem::policy_slice_allocator<mem::local_refcount, 1024, int> alloc(opt);
+
+            typedef mem::slice_ref<mem::slice_manager<1024, int>> ref_type;
+
+            std::vector<ref_type> v;
+            for(int i = 0; i < 1024; i++)
+                v.push_back(alloc.new_slice_ref(std::forward_as_tuple(i)));
+
+            auto m = v[0].manager();
+
+            for(int i = 0; i < 1000; i++) {
+                mem::recycle(v[0]);
+                v[0] = alloc.new_slice_ref(std::forward_as_tuple(i));
+            }
+
+            Assert( v[0].manager() == m );
+            Assert( alloc.stats().live_managers == 1 );
+            Assert( alloc.stats().standby_managers == 1 );
+        }
+
+        opt.recycle = false;
+
+        opt.standby = mem::standby_mode::thread;
+
+        {
+            mem::basic_slice_allocator<4, int> alloc(opt);
+
+            for(int n = 0; n < 1000 && alloc.stats().standby_managers == 0; n++)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            Assert( alloc.stats().standby_managers == 1 );
+            Assert( alloc.stats().live_managers == 1 );
+
+            std::vector<std::shared_ptr<int>> v;
+            for(int i = 0; i < 100; i++)
+                v.push_back(alloc.new_shared<int>(i));
+
+            for(int i = 0; i < 100; i++)
+                Assert( *v[static_cast<size_t>(i)] == i );
+        }
+    }
+
+
+    Test(allocator_stats)
+    {
+        mem::basic_slice_allocator<4, int> alloc;
+
+        mem::stats_page page("/mslice-regression-" + std::to_string(getpid()));
+        mem::stats_page monitor("/mslice-regression-" + std::to_string(getpid()), false);
+
+        alloc.export_stats(&page);
+
+        std::vector<std::shared_ptr<mem::slice<int>>> v;
+        for(int i = 0; i < 6; i++)
+            v.push_back(alloc.new_slice(mem::none));
+
+        auto st = alloc.stats();
+
+        Assert( st.slots_in_use == 2 );
+        Assert( st.slots_pinned == 4 );
+        Assert( st.live_managers == 2 );
+        Assert( st.arena_bytes == 2 * mem::sizeof_mem<4, int>() );
+#ifdef MSLICE_STATS
+        Assert( st.allocations == 6 );
+        Assert( st.rollovers == 1 );
+        Assert( st.managers_created == 2 );
+#else
+        Assert( st.allocations == 0 && st.rollovers == 0 && st.managers_created == 0 );
+#endif
+
+        // the page holds the snapshot taken at the rollover
+
+        auto pub = monitor.read();
+
+        Assert( monitor.generation() == 2 );
+        Assert( pub.slots_pinned == 4 );
+
+        v.clear();
+        alloc.publish_stats();
+
+        Assert( monitor.read().pool_size == 1 );
+#ifdef MSLICE_STATS
+        Assert( pub.rollovers == 1 );
+        Assert( monitor.read().managers_released == 1 );
+#endif
+    }
+
+
+    Test(stats_page_reset)
+    {
+        auto name = "/mslice-stale-" + std::to_string(getpid());
+
+        // a page left by a writer that crashed in the middle of a publish
+
+        auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+        Assert( fd >= 0 );
+        Assert( ftruncate(fd, sizeof(mem::stats_page::layout)) == 0 );
+
+        auto stale = static_cast<mem::stats_page::layout *>(mmap(nullptr, sizeof(mem::stats_page::layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        close(fd);
+
+        stale->seq.store(7);
+        stale->magic   = mem::stats_page::magic;
+        stale->version = mem::stats_page::version;
+        stale->fields  = mem::stats_page::fields;
+        stale->value[4].store(42);
+
+        {
+            mem::stats_page page(name);
+            mem::stats_page monitor(name, false);
+
+            Assert( monitor.generation() == 0 );
+            Assert( monitor.read().live_managers == 0 );
+        }
+
+        munmap(stale, sizeof(mem::stats_page::layout));
+
+        // readers check the layout before trusting it (the writer has
+        // unlinked the page)
+
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+        AssertThrow( mem::stats_page(name, false) );
+
+        Assert( ftruncate(fd, sizeof(mem::stats_page::layout)) == 0 );
+
+        stale = static_cast<mem::stats_page::layout *>(mmap(nullptr, sizeof(mem::stats_page::layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        close(fd);
+
+        AssertThrow( mem::stats_page(name, false) );
+
+        stale->magic   = mem::stats_page::magic;
+        stale->version = mem::stats_page::version;
+        stale->fields  = 3;
+        AssertThrow( mem::stats_page(name, false) );
+
+        stale->fields = mem::stats_page::fields;
+        Assert( mem::stats_page(name, false).generation() == 0 );
+
+        munmap(stale, sizeof(mem::stats_page::layout));
+        shm_unlink(name.c_str());
+    }
+
+
+    Test(pinned_managers)
+    {
+        mem::basic_slice_allocator<4, int> alloc;
+
+        auto keep = alloc.new_slice(mem::none);
+        for(int i = 0; i < 3; i++)
+            alloc.new_slice(mem::none);
+
+        auto cur = alloc.new_slice(mem::none);
+
+        auto pinned = alloc.pinned();
+
+        Assert( pinned.size() == 1 );
+        Assert( pinned[0].slots == 4 );
+        Assert( pinned[0].handles == 1 );
+        Assert( pinned[0].arena_bytes == mem::sizeof_mem<4, int>() );
+
+#ifdef MSLICE_DIAGNOSTICS
+        size_t sampled = 0;
+        for(auto &s : pinned[0].sites)
+            sampled += s.second;
+
+        Assert( sampled == 4 );
+#else
+        Assert( pinned[0].sites.empty() );
+#endif
+
+        keep.reset();
+        Assert( alloc.pinned().empty() );
+
+        // local policy: handles are the manager refcount
+
+        mem::policy_slice_allocator<mem::local_refcount, 4, int> local;
+
+        std::vector<mem::local_ptr<mem::slice<int>>> v;
+        for(int i = 0; i < 6; i++)
+            v.push_back(local.new_slice(mem::none));
+
+        v.erase(v.begin(), v.begin() + 2);
+
+        auto lp = local.pinned();
+
+        Assert( lp.size() == 1 );
+        Assert( lp[0].handles == 2 );
+    }
+
+
+    Test(dynamic_capacity)
+    {
+        mem::allocator_options opt;
+        opt.capacity = 8;
+
+        mem::dynamic_slice_allocator<int, std::string> alloc(opt);
+
+        std::vector<std::shared_ptr<mem::slice<int, std::string>>> v;
+        for(int i = 0; i < 10; i++)
+            v.push_back(alloc.new_slice(std::make_tuple(i), std::make_tuple("x")));
+
+        Assert( alloc.capacity() == 8 );
+        Assert( alloc.stats().slots_pinned == 8 );
+        Assert( alloc.stats().arena_bytes == 2 * mem::sizeof_mem<int, std::string>(8) );
+        Assert( *mem::get<0>(*v[9]) == 9 );
+
+        // adaptive: grow while the managers are released right away...
+
+        opt.capacity_min = 4;
+        opt.capacity_max = 32;
+        opt.adapt_pinned = 1;
+        opt.adapt_period = std::chrono::hours(1);
+
+        mem::dynamic_slice_allocator<int> adaptive(opt);
+
+        for(int i = 0; i < 8; i++)
+            adaptive.new_slice(mem::none);
+
+        adaptive.new_slice(mem::none);
+        Assert( adaptive.capacity() == 16 );
+
+        for(int i = 0; i < 15 + 32 + 32; i++)
+            adaptive.new_slice(mem::none);
+
+        Assert( adaptive.capacity() == 32 );
+
+        // ...and shrink when long-lived slices pin the arenas
+
+        std::vector<std::shared_ptr<mem::slice<int>>> keep;
+        for(int i = 0; i < 32 * 2 + 1; i++)
+        {
+            auto s = adaptive.new_slice(mem::none);
+            if (i % 32 == 0)
+                keep.push_back(s);
+        }
+
+        Assert( adaptive.capacity() == 16 );
+        Assert( adaptive.new_slices(4, mem::none).size() == 4 );
+    }
+
+
+    Test(node_arena)
+    {
+        mem::node_arena arena(4096);
+
+        {
+            std::list<int, mem::arena_allocator<int>> l{mem::arena_allocator<int>(arena)};
+
+            for(int i = 0; i < 1000; i++)
+                l.push_back(i);
+
+            Assert( arena.chunks() > 1 );
+            Assert( l.back() == 999 );
+
+            // the retired chunks go back to the cache once empty
+
+            for(int i = 0; i < 900; i++)
+                l.pop_front();
+
+            Assert( arena.cached() > 0 );
+            Assert( l.front() == 900 );
+        }
+
+        Assert( arena.chunks() == 1 );
+
+        typedef std::unordered_map<int, std::string, std::hash<int>, std::equal_to<int>,
+                                   mem::arena_allocator<std::pair<const int, std::string>>> map_type;
+
+        map_type m(16, std::hash<int>(), std::equal_to<int>(), map_type::allocator_type(arena));
+
+        for(int i = 0; i < 100; i++)
+            m.emplace(i, std::to_string(i));
+
+        Assert( m.size() == 100 );
+        Assert( m[42] == "42" );
+        Assert( m.get_allocator() == mem::arena_allocator<char>(arena) );
+
+        AssertThrow( mem::node_arena(1000) );
+
+        // a zero-byte node at the end of a full chunk comes from the next one
+
+        {
+            mem::node_arena small(4096);
+
+            std::vector<void *> v;
+            do
+                v.push_back(small.allocate(8, 8));
+            while ((reinterpret_cast<uintptr_t>(v.back()) + 8) % 4096 != 0);
+
+            Assert( small.chunks() == 1 );
+
+            auto z = small.allocate(0, 1);
+
+            Assert( small.chunks() == 2 );
+            Assert( reinterpret_cast<uintptr_t>(z) / 4096 != reinterpret_cast<uintptr_t>(v.back()) / 4096 );
+
+            small.deallocate(z, 0, 1);
+            for(auto p : v)
+                small.deallocate(p, 8, 8);
+
+            Assert( small.chunks() == 1 );
+        }
+
+        // mapped chunks are aligned to their size as well
+
+        for(auto backing : { mem::arena_backing::mmap, mem::arena_backing::transparent })
+        {
+            mem::allocator_options opt;
+            opt.arena.backing = backing;
+
+            mem::node_arena mapped(1 << 20, opt);
+
+            std::list<int, mem::arena_allocator<int>> l{mem::arena_allocator<int>(mapped)};
+
+            for(int i = 0; i < 200000; i++)
+                l.push_back(i);
+
+            Assert( mapped.chunks() > 1 );
+
+            l.clear();
+            Assert( mapped.chunks() == 1 );
+        }
+    }
+
+
+    Test(byte_regions)
+    {
+        mem::allocator_options opt;
+        opt.region_bytes = 4096;
+
+        mem::basic_slice_allocator<64, int, mem::packet_bytes> alloc(opt);
+
+        const char frame[] = "0123456789abcdef";
+
+        auto a = alloc.new_slice(std::make_tuple(1), std::make_tuple(frame, sizeof(frame)));
+        auto b = alloc.new_slice(std::make_tuple(2), std::make_tuple(1500));
+        auto c = alloc.new_slice(std::make_tuple(3), mem::none);
+
+        auto ra = mem::get<1>(a);
+
+        Assert( ra->size() == sizeof(frame) );
+        Assert( ra->capacity() == 128 );
+        Assert( std::memcmp(ra->data(), frame, sizeof(frame)) == 0 );
+        Assert( mem::get<1>(b)->capacity() == 2048 );
+        Assert( mem::get<1>(b)->data() == ra->data() + 128 );
+        Assert( mem::get<1>(c)->empty() );
+
+        ra->resize(100);
+        Assert( ra->size() == 100 );
+        AssertThrow( ra->resize(129) );
+
+        // the secondary region is full: the allocator rolls over
+
+        auto d = alloc.new_slice(std::make_tuple(4), std::make_tuple(2048));
+
+        Assert( alloc.stats().live_managers == 2 );
+        Assert( alloc.stats().slots_pinned == 3 );
+
+        AssertThrow( alloc.new_slice(std::make_tuple(5), std::make_tuple(9217)) );
+
+        // no size classes: lengths rounded to 16 bytes
+
+        mem::basic_slice_allocator<64, mem::bytes<>> exact(opt);
+
+        auto batch = exact.new_slices(4, std::make_tuple(10));
+
+        Assert( batch.size() == 4 );
+        Assert( mem::get<0>(batch[1])->capacity() == 16 );
+        Assert( mem::get<0>(batch[1])->data() == mem::get<0>(batch[0])->data() + 16 );
+
+        // a manager used directly checks the bounds of its region
+
+        mem::slice_manager<4, mem::bytes<>> m(mem::arena_options(), {}, 4, 4096);
+
+        m.alloc(std::make_tuple(4096));
+
+        Assert( m.region_available() == 0 );
+        AssertThrow( m.alloc(std::make_tuple(16)) );
+    }
+
+
+    Test(external_region)
+    {
+        typedef std::array<uint8_t, 64> frame;
+
+        // ring memory filled by a producer
+
+        std::vector<frame> ring(8);
+        for(size_t i = 0; i < ring.size(); i++)
+            ring[i].fill(static_cast<uint8_t>(i));
+
+        int released = 0;
+
+        mem::dynamic_slice_allocator<mem::uninitialized<frame>> alloc;
+
+        alloc.adopt(mem::external_region{ ring.data(), ring.size() * sizeof(frame), [&](void *addr, size_t size) {
+                        Assert( addr == ring.data() );
+                        Assert( size == 8 * sizeof(frame) );
+                        released++;
+                    }});
+
+        Assert( alloc.backing() == mem::arena_backing::external );
+
+        std::vector<std::shared_ptr<mem::slice<mem::uninitialized<frame>>>> v;
+        for(int i = 0; i < 8; i++)
+            v.push_back(alloc.new_slice(mem::none));
+
+        // the slices sit on the ring, no copy
+
+        Assert( mem::get<0>(v[3]) == &ring[3] );
+        Assert( (*mem::get<0>(v[3]))[0] == 3 );
+
+        alloc.retire();
+        Assert( alloc.backing() != mem::arena_backing::external );
+
+        v.resize(1);
+        Assert( released == 0 );
+
+        v.clear();
+        Assert( released == 1 );
+        Assert( alloc.pool_size() == 0 );
+
+        // a fixed capacity must fit in the region
+
+        mem::basic_slice_allocator<16, frame> fixed;
+        AssertThrow( fixed.adopt(mem::external_region{ ring.data(), ring.size() * sizeof(frame), nullptr }) );
+
+        Assert( mem::slots_in<frame>(ring.size() * sizeof(frame)) == 8 );
+    }
+
+
+    Test(persistent_arena)
+    {
+        struct point { point(int a, int b) : x(a), y(b) {} int x, y; };
+
+        auto path = "/tmp/mslice-persistent-" + std::to_string(getpid());
+        unlink(path.c_str());
+
+        {
+            mem::persistent_arena<point, uint64_t> a(path, 100, 1);
+
+            Assert( !a.reopened() );
+            Assert( a.capacity() == 100 );
+
+            for(int i = 0; i < 10; i++)
+                Assert( a.alloc(std::make_tuple(i, -i), std::make_tuple(static_cast<uint64_t>(i * 10))) == static_cast<size_t>(i) );
+
+            a.erase(3);
+            a.erase(7);
+            Assert( !a.live(3) && a.live(4) && !a.live(10) );
+        }
+
+        {
+            mem::persistent_arena<point, uint64_t> a(path, 0, 1);
+
+            Assert( a.reopened() && a.clean() );
+            Assert( a.capacity() == 100 && a.size() == 10 );
+
+            size_t n = 0;
+            a.for_each([&](size_t i) {
+                Assert( a.slot<point>(i)->x == static_cast<int>(i) );
+                Assert( *a.slot<1>(i) == i * 10 );
+                n++;
+            });
+            Assert( n == 8 );
+
+            Assert( a.alloc(std::make_tuple(10, -10), std::make_tuple(uint64_t(100))) == 10 );
+        }
+
+        // schema, capacity and layout are checked on reopen
+
+        AssertThrow( (mem::persistent_arena<point, uint64_t>(path, 0, 2)) );
+        AssertThrow( (mem::persistent_arena<point, uint64_t>(path, 50, 1)) );
+        AssertThrow( (mem::persistent_arena<point, uint32_t>(path, 0, 1)) );
+        AssertThrow( (mem::persistent_arena<uint64_t, point>(path, 0, 1)) );
+
+        {
+            mem::persistent_arena<point, uint64_t> a(path, 0, 1);
+            Assert( a.size() == 11 && a.live(10) );
+        }
+
+        unlink(path.c_str());
+        AssertThrow( (mem::persistent_arena<point, uint64_t>(path, 0, 1)) );
+    }
+
+
+    Test(persistent_arena_recovery)
+    {
+        typedef mem::persistent_arena<uint64_t> arena_type;
+        typedef arena_type::header header;
+
+        auto path = "/tmp/mslice-recovery-" + std::to_string(getpid());
+        unlink(path.c_str());
+
+        auto poke = [&](off_t off, void const *data, size_t len) {
+            auto fd = open(path.c_str(), O_RDWR);
+            Assert( pwrite(fd, data, len, off) == static_cast<ssize_t>(len) );
+            close(fd);
+        };
+
+        auto peek = [&](off_t off, void *data, size_t len) {
+            auto fd = open(path.c_str(), O_RDONLY);
+            Assert( pread(fd, data, len, off) == static_cast<ssize_t>(len) );
+            close(fd);
+        };
+
+        {
+            arena_type a(path, 64);
+            for(uint64_t i = 0; i < 4; i++)
+                a.alloc(std::make_tuple(i + 100));
+        }
+
+        // a process that died with the arena open leaves the dirty flag:
+        // the arena opens, and reports it
+
+        uint32_t dirty = 0;
+        poke(offsetof(header, clean), &dirty, sizeof(dirty));
+
+        {
+            arena_type a(path, 0);
+            Assert( !a.clean() );
+            Assert( a.size() == 4 && *a.slot<0>(3) == 103 );
+        }
+        {
+            arena_type a(path, 0);
+            Assert( a.clean() );
+        }
+
+        // a corrupted byte in the header fails the checksum
+
+        uint8_t byte;
+        peek(offsetof(header, size), &byte, 1);
+        byte ^= 0x10;
+        poke(offsetof(header, size), &byte, 1);
+
+        AssertThrow( arena_type(path, 0) );
+
+        byte ^= 0x10;
+        poke(offsetof(header, size), &byte, 1);
+
+        { arena_type a(path, 0); Assert( a.size() == 4 ); }
+
+        // a truncated file is rejected
+
+        struct stat st;
+        Assert( stat(path.c_str(), &st) == 0 );
+        Assert( truncate(path.c_str(), st.st_size - 4096) == 0 );
+
+        AssertThrow( arena_type(path, 0) );
+
+        unlink(path.c_str());
+    }
 }
 
 
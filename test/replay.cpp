@@ -0,0 +1,665 @@
+/* Copyright (c) 2012, University of Pisa - Consorzio Nazionale Interuniversitario
+ * per le Telecomunicazioni.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of Interuniversitario per le Telecomunicazioni nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT
+ * HOLDERBE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE
+ */
+
+/*
+ * Author: Nicola Bonelli <nicola.bonelli@cnit.it>
+ */
+
+// offline replay: packets of a pcap/pcapng capture, mapped in memory,
+// are decoded (ethernet, ipv4/ipv6, tcp/udp) into multi-layer slices and
+// kept in a window of the most recent ones, as a pipeline would do. The
+// slice allocators are compared against malloc and make_shared. Memory
+// per packet is the heap and arena footprint of the packets held by the
+// window at the end of the replay, handles included (the arenas are
+// mapped, so that they are not counted in the heap). The synthetic
+// capture generator keeps the benchmark self-contained:
+//
+//   test-replay gen capture.pcap[ng] [packets]
+//   test-replay mode capture.pcap[ng] [loops] [window]
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <tuple>
+
+#include <iostream>
+
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <mslice.hpp>
+
+
+// decoded layers
+//
+
+struct eth_layer
+{
+    uint8_t  dst[6];
+    uint8_t  src[6];
+    uint16_t vlan;          // 0 if untagged
+    uint16_t type;
+};
+
+struct ip_layer
+{
+    uint8_t  version;       // 4 or 6, 0 if not ip
+    uint8_t  proto;
+    uint8_t  ttl;
+    uint16_t len;
+    uint8_t  src[16];
+    uint8_t  dst[16];
+};
+
+struct l4_layer
+{
+    uint8_t  proto;         // 6 (tcp), 17 (udp), 0 otherwise
+    uint8_t  flags;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t seq;
+};
+
+struct payload_ref
+{
+    uint8_t const *data;    // into the mapped capture
+    uint32_t len;
+};
+
+
+inline uint16_t
+rd16(uint8_t const *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint32_t
+rd32(uint8_t const *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+
+// decode a frame, false if truncated before the network layer
+//
+
+inline bool
+decode(uint8_t const *p, size_t len, eth_layer &eth, ip_layer &ip, l4_layer &l4, payload_ref &pl)
+{
+    std::memset(&ip, 0, sizeof(ip));
+    std::memset(&l4, 0, sizeof(l4));
+
+    if (len < 14)
+        return false;
+
+    std::memcpy(eth.dst, p, 6);
+    std::memcpy(eth.src, p + 6, 6);
+    eth.vlan = 0;
+    eth.type = rd16(p + 12);
+
+    size_t off = 14;
+
+    if (eth.type == 0x8100 && len >= 18) {
+        eth.vlan = rd16(p + 14) & 0xfff;
+        eth.type = rd16(p + 16);
+        off = 18;
+    }
+
+    if (eth.type == 0x0800 && len >= off + 20)
+    {
+        auto h = p + off;
+        ip.version = 4;
+        ip.proto   = h[9];
+        ip.ttl     = h[8];
+        ip.len     = rd16(h + 2);
+        std::memcpy(ip.src, h + 12, 4);
+        std::memcpy(ip.dst, h + 16, 4);
+        off += static_cast<size_t>(h[0] & 0x0f) * 4;
+    }
+    else if (eth.type == 0x86dd && len >= off + 40)
+    {
+        auto h = p + off;
+        ip.version = 6;
+        ip.proto   = h[6];
+        ip.ttl     = h[7];
+        ip.len     = static_cast<uint16_t>(rd16(h + 4) + 40);
+        std::memcpy(ip.src, h + 8, 16);
+        std::memcpy(ip.dst, h + 24, 16);
+        off += 40;
+    }
+
+    if (ip.proto == 6 && len >= off + 20)
+    {
+        auto h = p + off;
+        l4.proto = 6;
+        l4.sport = rd16(h);
+        l4.dport = rd16(h + 2);
+        l4.seq   = rd32(h + 4);
+        l4.flags = h[13];
+        off += static_cast<size_t>(h[12] >> 4) * 4;
+    }
+    else if (ip.proto == 17 && len >= off + 8)
+    {
+        auto h = p + off;
+        l4.proto = 17;
+        l4.sport = rd16(h);
+        l4.dport = rd16(h + 2);
+        off += 8;
+    }
+
+    off     = std::min(off, len);
+    pl.data = p + off;
+    pl.len  = static_cast<uint32_t>(len - off);
+    return ip.version != 0;
+}
+
+
+/////////////////////////////////////////////////////////////
+// capture files: the frames of a pcap or pcapng file mapped in memory
+//
+
+struct frame
+{
+    uint8_t const *data;
+    uint32_t len;           // captured length
+};
+
+struct capture
+{
+    explicit capture(const char *name)
+    : addr_(nullptr)
+    , len_(0)
+    , frames()
+    {
+        int fd = open(name, O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error(std::string("capture: cannot open ").append(name));
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < 24) {
+            close(fd);
+            throw std::runtime_error("capture: not a capture file");
+        }
+
+        len_  = static_cast<size_t>(st.st_size);
+        addr_ = mmap(nullptr, len_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd);
+
+        if (addr_ == MAP_FAILED)
+            throw std::runtime_error("capture: mmap failed");
+
+        auto p = static_cast<uint8_t const *>(addr_);
+        uint32_t magic;
+        std::memcpy(&magic, p, 4);
+
+        if (magic == 0x0a0d0d0a)
+            parse_pcapng(p);
+        else
+            parse_pcap(p, magic);
+    }
+
+    ~capture()
+    {
+        munmap(addr_, len_);
+    }
+
+    capture(const capture &) = delete;
+    capture& operator=(const capture &) = delete;
+
+private:
+
+    // classic pcap, microsecond or nanosecond timestamps, host byte order
+    // (swapped captures are not supported)
+    //
+
+    void
+    parse_pcap(uint8_t const *p, uint32_t magic)
+    {
+        if (magic != 0xa1b2c3d4 && magic != 0xa1b23c4d)
+            throw std::runtime_error("capture: unknown or byte-swapped format");
+
+        for(size_t off = 24; off + 16 <= len_; )
+        {
+            uint32_t caplen;
+            std::memcpy(&caplen, p + off + 8, 4);
+            off += 16;
+
+            if (off + caplen > len_)
+                break;
+
+            frames.push_back(frame{ p + off, caplen });
+            off += caplen;
+        }
+    }
+
+    // pcapng: enhanced and simple packet blocks of a single section
+    //
+
+    void
+    parse_pcapng(uint8_t const *p)
+    {
+        for(size_t off = 0; off + 12 <= len_; )
+        {
+            uint32_t type, size;
+            std::memcpy(&type, p + off, 4);
+            std::memcpy(&size, p + off + 4, 4);
+
+            if (size < 12 || (size & 3) || off + size > len_)
+                break;
+
+            if (type == 6 && size >= 32) {         // enhanced packet block
+                uint32_t caplen;
+                std::memcpy(&caplen, p + off + 20, 4);
+                if (32 + static_cast<size_t>(caplen) <= size)   // data and trailing length
+                    frames.push_back(frame{ p + off + 28, caplen });
+            }
+            else if (type == 3 && size >= 16) {    // simple packet block
+                uint32_t len;
+                std::memcpy(&len, p + off + 8, 4);
+                frames.push_back(frame{ p + off + 12, std::min(len, size - 16) });
+            }
+
+            off += size;
+        }
+    }
+
+    void  *addr_;
+    size_t len_;
+
+public:
+    std::vector<frame> frames;
+};
+
+
+/////////////////////////////////////////////////////////////
+// synthetic capture generator: ipv4/ipv6, tcp/udp, some vlan tagged
+// frames, 64/576/1500 bytes
+//
+
+struct capture_writer
+{
+    explicit capture_writer(const char *name)
+    : f_(fopen(name, "wb"))
+    , ng_(std::string(name).size() > 7 && std::string(name).compare(std::string(name).size() - 7, 7, ".pcapng") == 0)
+    {
+        if (!f_)
+            throw std::runtime_error(std::string("capture: cannot create ").append(name));
+
+        if (ng_)
+        {
+            // section header block and interface description block (ethernet)
+
+            uint32_t shb[7] = { 0x0a0d0d0a, 28, 0x1a2b3c4d, 0x00000001, 0xffffffff, 0xffffffff, 28 };
+            uint32_t idb[5] = { 1, 20, 1, 65535, 20 };
+            write(shb, sizeof(shb));
+            write(idb, sizeof(idb));
+        }
+        else
+        {
+            uint32_t hdr[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1 };
+            write(hdr, sizeof(hdr));
+        }
+    }
+
+    ~capture_writer()
+    {
+        fclose(f_);
+    }
+
+    capture_writer(const capture_writer &) = delete;
+    capture_writer& operator=(const capture_writer &) = delete;
+
+    void
+    add(std::vector<uint8_t> const &pkt, uint64_t usec)
+    {
+        auto len = static_cast<uint32_t>(pkt.size());
+
+        if (ng_)
+        {
+            auto pad  = (4 - (len & 3)) & 3;
+            auto size = 32 + len + pad;
+            uint32_t epb[7] = { 6, size, 0, static_cast<uint32_t>(usec >> 32), static_cast<uint32_t>(usec), len, len };
+            uint32_t zero = 0;
+            write(epb, sizeof(epb));
+            write(pkt.data(), len);
+            write(&zero, pad);
+            write(&size, 4);
+        }
+        else
+        {
+            uint32_t rec[4] = { static_cast<uint32_t>(usec / 1000000), static_cast<uint32_t>(usec % 1000000), len, len };
+            write(rec, sizeof(rec));
+            write(pkt.data(), len);
+        }
+    }
+
+private:
+
+    void
+    write(void const *p, size_t n)
+    {
+        if (n && fwrite(p, n, 1, f_) != 1)
+            throw std::runtime_error("capture: write error");
+    }
+
+    FILE *f_;
+    bool  ng_;
+};
+
+
+inline void
+put16(std::vector<uint8_t> &v, size_t off, uint16_t x)
+{
+    v[off]     = static_cast<uint8_t>(x >> 8);
+    v[off + 1] = static_cast<uint8_t>(x);
+}
+
+inline void
+put32(std::vector<uint8_t> &v, size_t off, uint32_t x)
+{
+    put16(v, off, static_cast<uint16_t>(x >> 16));
+    put16(v, off + 2, static_cast<uint16_t>(x));
+}
+
+void
+generate(const char *name, uint64_t packets)
+{
+    capture_writer w(name);
+    uint64_t rnd = 0x9e3779b97f4a7c15ULL;
+
+    for(uint64_t n = 0; n < packets; n++)
+    {
+        rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+
+        bool v6   = (rnd & 7) == 0;
+        bool udp  = (rnd >> 3 & 3) == 0;
+        bool vlan = (rnd >> 5 & 15) == 0;
+        auto size = (rnd >> 9) % 100;
+        size_t len = size < 55 ? 64 : size < 75 ? 576 : 1500;
+
+        std::vector<uint8_t> pkt(len, 0);
+
+        size_t off = 12;
+        std::memset(pkt.data(), 0x02, 12);
+        pkt[11] = static_cast<uint8_t>(n);
+
+        if (vlan) {
+            put16(pkt, 12, 0x8100);
+            put16(pkt, 14, static_cast<uint16_t>(n & 0xfff));
+            off = 16;
+        }
+
+        put16(pkt, off, v6 ? 0x86dd : 0x0800);
+        off += 2;
+
+        auto l3len = len - off;
+        auto proto = static_cast<uint8_t>(udp ? 17 : 6);
+        auto flow  = static_cast<uint32_t>((rnd >> 16) & 0xffff);
+
+        if (v6) {
+            pkt[off] = 0x60;
+            put16(pkt, off + 4, static_cast<uint16_t>(l3len - 40));
+            pkt[off + 6] = proto;
+            pkt[off + 7] = 64;
+            put32(pkt, off + 8, 0x20010db8);
+            put32(pkt, off + 20, flow);
+            put32(pkt, off + 24, 0x20010db8);
+            put32(pkt, off + 36, 1);
+            off += 40;
+        }
+        else {
+            pkt[off] = 0x45;
+            put16(pkt, off + 2, static_cast<uint16_t>(l3len));
+            pkt[off + 8] = 64;
+            pkt[off + 9] = proto;
+            put32(pkt, off + 12, 0x0a000000 | flow);
+            put32(pkt, off + 16, 0x0a100001);
+            off += 20;
+        }
+
+        put16(pkt, off, static_cast<uint16_t>(1024 + (flow & 0x3fff)));
+        put16(pkt, off + 2, udp ? 53 : 443);
+
+        if (udp)
+            put16(pkt, off + 4, static_cast<uint16_t>(len - off));
+        else {
+            put32(pkt, off + 4, static_cast<uint32_t>(n));
+            pkt[off + 12] = 0x50;
+            pkt[off + 13] = 0x18;
+        }
+
+        w.add(pkt, n * 10);
+    }
+}
+
+
+/////////////////////////////////////////////////////////////
+// packet allocators: build a packet out of the decoded layers
+//
+
+struct decode_only
+{
+    typedef int packet_type;
+
+    packet_type
+    operator()(eth_layer const &, ip_layer const &, l4_layer const &, payload_ref const &)
+    {
+        return 0;
+    }
+
+    size_t arena_bytes() const { return 0; }
+};
+
+struct malloc_packet
+{
+    std::unique_ptr<eth_layer>   eth;
+    std::unique_ptr<ip_layer>    ip;
+    std::unique_ptr<l4_layer>    l4;
+    std::unique_ptr<payload_ref> payload;
+};
+
+struct malloc_allocator
+{
+    typedef malloc_packet packet_type;
+
+    packet_type
+    operator()(eth_layer const &eth, ip_layer const &ip, l4_layer const &l4, payload_ref const &pl)
+    {
+        return packet_type{ std::unique_ptr<eth_layer>(new eth_layer(eth)), std::unique_ptr<ip_layer>(new ip_layer(ip)),
+                            std::unique_ptr<l4_layer>(new l4_layer(l4)), std::unique_ptr<payload_ref>(new payload_ref(pl)) };
+    }
+
+    size_t arena_bytes() const { return 0; }
+};
+
+struct shared_packet
+{
+    std::shared_ptr<eth_layer>   eth;
+    std::shared_ptr<ip_layer>    ip;
+    std::shared_ptr<l4_layer>    l4;
+    std::shared_ptr<payload_ref> payload;
+};
+
+struct shared_allocator
+{
+    typedef shared_packet packet_type;
+
+    packet_type
+    operator()(eth_layer const &eth, ip_layer const &ip, l4_layer const &l4, payload_ref const &pl)
+    {
+        return packet_type{ std::make_shared<eth_layer>(eth), std::make_shared<ip_layer>(ip),
+                            std::make_shared<l4_layer>(l4), std::make_shared<payload_ref>(pl) };
+    }
+
+    size_t arena_bytes() const { return 0; }
+};
+
+template <typename Policy>
+struct mslice_allocator
+{
+    typedef mem::policy_slice_allocator<Policy, 4096, eth_layer, ip_layer, l4_layer, payload_ref> allocator_type;
+    typedef typename allocator_type::template pointer<typename allocator_type::slice_type> packet_type;
+
+    // the arenas are mapped: the heap only holds the bookkeeping
+
+    static mem::allocator_options
+    options()
+    {
+        mem::allocator_options opt;
+        opt.arena.backing = mem::arena_backing::mmap;
+        return opt;
+    }
+
+    mslice_allocator()
+    : alloc(options())
+    {}
+
+    packet_type
+    operator()(eth_layer const &eth, ip_layer const &ip, l4_layer const &l4, payload_ref const &pl)
+    {
+        return alloc.new_slice(std::forward_as_tuple(eth), std::forward_as_tuple(ip), std::forward_as_tuple(l4), std::forward_as_tuple(pl));
+    }
+
+    size_t arena_bytes() const { return alloc.stats().arena_bytes; }
+
+    allocator_type alloc;
+};
+
+
+inline size_t
+heap_bytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+
+// replay the capture loops times, keeping the last window packets
+//
+
+template <typename Alloc>
+void
+replay(const char *name, capture const &cap, unsigned loops, size_t window)
+{
+    typedef typename Alloc::packet_type packet_type;
+
+    if (cap.frames.empty())
+        throw std::runtime_error("capture: no frames");
+
+    auto heap0 = heap_bytes();
+
+    Alloc allocator;
+    std::vector<packet_type> ring(window);
+
+    uint64_t n = 0, skipped = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(unsigned l = 0; l < loops; l++)
+    {
+        for(auto &f : cap.frames)
+        {
+            eth_layer eth; ip_layer ip; l4_layer l4; payload_ref pl;
+
+            if (!decode(f.data, f.len, eth, ip, l4, pl)) {
+                skipped++;
+                continue;
+            }
+
+            ring[n++ % window] = allocator(eth, ip, l4, pl);
+        }
+    }
+
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (n == 0) {
+        std::cout << name << ": no packets decoded (" << skipped << " skipped)" << std::endl;
+        return;
+    }
+
+    // footprint of the packets held by the window at the end
+
+    auto heap  = heap_bytes() - heap0;
+    auto arena = allocator.arena_bytes();
+    auto held  = std::min<uint64_t>(n, window);
+
+    std::cout << name << ": " << n << " packets (" << skipped << " skipped), "
+              << static_cast<double>(n) / secs / 1000000 << " Mpps, "
+              << secs * 1e9 / static_cast<double>(n) << " ns/packet, "
+              << static_cast<double>(heap + arena) / static_cast<double>(held) << " bytes/packet"
+              << std::endl;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 3)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" gen capture.pcap[ng] [packets] | mode capture.pcap[ng] [loops] [window]"));
+
+    if (std::string(argv[1]) == "gen")
+    {
+        generate(argv[2], argc > 3 ? static_cast<uint64_t>(atoll(argv[3])) : 100000);
+        return 0;
+    }
+
+    const auto mode   = static_cast<unsigned int>(atoi(argv[1]));
+    const auto loops  = argc > 3 ? static_cast<unsigned int>(atoi(argv[3])) : 10;
+    const auto window = argc > 4 ? static_cast<size_t>(atol(argv[4])) : 65536;
+
+    if (window == 0)
+        throw std::runtime_error("the window must hold at least one packet");
+
+    capture cap(argv[2]);
+
+    switch(mode)
+    {
+        case 0: replay<decode_only>("decode", cap, loops, window); break;
+        case 1: replay<malloc_allocator>("malloc", cap, loops, window); break;
+        case 2: replay<shared_allocator>("make_shared", cap, loops, window); break;
+        case 3: replay<mslice_allocator<mem::shared_refcount>>("slice_allocator", cap, loops, window); break;
+        case 4: replay<mslice_allocator<mem::local_refcount>>("slice_allocator+local_refcount", cap, loops, window); break;
+        default:
+            throw std::runtime_error("mode not implemented");
+    }
+
+    return 0;
+}
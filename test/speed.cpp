@@ -39,11 +39,22 @@
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <mutex>
+#include <cstdint>
 
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
 
 #include <mslice.hpp>
 
+#include <pthread.h>
+#include <sched.h>
+
 namespace vt100
 {
     const char * const BOLD  = "\E[1m";
@@ -88,20 +99,370 @@ struct shared_allocator
 };
 
 
+inline mem::allocator_options
+arena_options(mem::arena_backing backing, bool prefault, mem::standby_mode standby = mem::standby_mode::none)
+{
+    mem::allocator_options opt;
+    opt.arena.backing  = backing;
+    opt.arena.prefault = prefault;
+    opt.standby        = standby;
+    return opt;
+}
+
+
+template <typename Policy, mem::arena_backing Backing = mem::arena_backing::heap, bool Prefault = false,
+          mem::standby_mode Standby = mem::standby_mode::none>
 struct mslice_allocator
 {
+    typedef mem::policy_slice_allocator<Policy, 131072, target_type> allocator_type;
+
     mslice_allocator()
-    : alloc()
+    : alloc(arena_options(Backing, Prefault, Standby))
     {}
     
+    typename allocator_type::template pointer<mem::slice<target_type>>
+    operator()() 
+    {
+        return alloc.new_slice(mem::none);
+    }
+
+    allocator_type alloc;
+};
+
+
+// slice allocator whose capacity is set at runtime, possibly adaptive
+// between 4096 and 131072 slots
+//
+
+template <bool Adaptive>
+struct dynamic_mslice_allocator
+{
+    typedef mem::dynamic_slice_allocator<target_type> allocator_type;
+
+    static mem::allocator_options
+    options()
+    {
+        mem::allocator_options opt;
+        if (Adaptive) {
+            opt.capacity_min = 4096;
+            opt.capacity_max = 131072;
+        }
+        return opt;
+    }
+
+    dynamic_mslice_allocator()
+    : alloc(options())
+    {}
+
     std::shared_ptr<mem::slice<target_type>>
     operator()() 
     {
-        auto sp = alloc.new_slice(mem::none);
-        return std::move(sp);
+        return alloc.new_slice(mem::none);
+    }
+
+    allocator_type alloc;
+};
+
+
+// slice allocator returning compact handles (manager + slot index)
+//
+
+struct ref_mslice_allocator
+{
+    typedef mem::local_slice_allocator<target_type> allocator_type;
+    typedef mem::slice_ref<allocator_type::manager_type> pointer_type;
+
+    pointer_type
+    operator()() 
+    {
+        return alloc.new_slice_ref(mem::none);
+    }
+
+    allocator_type alloc;
+};
+
+
+// slice allocator whose target layer has a construction policy
+// (mem::uninitialized, mem::prototyped)
+//
+
+inline void
+install_prototype(mem::slice_allocator<mem::prototyped<target_type>> &alloc)
+{
+    target_type proto;
+    proto.fill('x');
+    alloc.prototype<0>(proto);
+}
+
+template <typename Alloc>
+inline void
+install_prototype(Alloc &)
+{
+}
+
+
+template <typename Layer>
+struct construction_mslice_allocator
+{
+    typedef mem::slice_allocator<Layer> allocator_type;
+
+    construction_mslice_allocator()
+    {
+        install_prototype(alloc);
+    }
+
+    std::shared_ptr<mem::slice<Layer>>
+    operator()() 
+    {
+        return alloc.new_slice(mem::none);
     }
 
-    mem::slice_allocator<target_type> alloc;
+    allocator_type alloc;
+};
+
+
+struct concurrent_mslice_allocator
+{
+    static mem::concurrent_slice_allocator<target_type> &
+    instance()
+    {
+        static mem::concurrent_slice_allocator<target_type> alloc;
+        return alloc;
+    }
+
+    std::shared_ptr<mem::slice<target_type>>
+    operator()() 
+    {
+        return instance().new_slice(mem::none);
+    }
+};
+
+
+// latency measurements: rdtsc where available (converted to nanoseconds
+// with a calibration against steady_clock), steady_clock otherwise
+//
+
+inline uint64_t
+ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+inline double
+ticks_per_ns()
+{
+    static double ratio = []
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        auto t0 = std::chrono::steady_clock::now();
+        auto c0 = ticks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto c1 = ticks();
+        auto t1 = std::chrono::steady_clock::now();
+        return static_cast<double>(c1 - c0) / static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+#else
+        return 1.0;
+#endif
+    }();
+
+    return ratio;
+}
+
+
+// log-bucketed histogram: 8 sub-buckets per power of two, exact below 16
+//
+
+struct latency_histogram
+{
+    enum : size_t { sub_bits = 3, linear = 16, buckets = linear + (64 - 4) * (1 << sub_bits) };
+
+    latency_histogram()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        std::fill(std::begin(count_), std::end(count_), 0);
+        total_ = 0;
+        max_   = 0;
+    }
+
+    void add(uint64_t v)
+    {
+        count_[index(v)]++;
+        total_++;
+        max_ = std::max(max_, v);
+    }
+
+    uint64_t quantile(double q) const
+    {
+        auto target = static_cast<uint64_t>(q * static_cast<double>(total_));
+        uint64_t acc = 0;
+
+        for(size_t i = 0; i < buckets; i++)
+        {
+            acc += count_[i];
+            if (acc > target)
+                return lower_bound(i);
+        }
+
+        return max_;
+    }
+
+    uint64_t max() const
+    {
+        return max_;
+    }
+
+    void merge(latency_histogram const &other)
+    {
+        for(size_t i = 0; i < buckets; i++)
+            count_[i] += other.count_[i];
+        total_ += other.total_;
+        max_    = std::max(max_, other.max_);
+    }
+
+    uint64_t total() const
+    {
+        return total_;
+    }
+
+private:
+
+    static size_t index(uint64_t v)
+    {
+        if (v < linear)
+            return static_cast<size_t>(v);
+
+        auto octave = static_cast<size_t>(63 - __builtin_clzll(v));
+        auto sub    = static_cast<size_t>(v >> (octave - sub_bits)) & ((1 << sub_bits) - 1);
+
+        return linear + (octave - 4) * (1 << sub_bits) + sub;
+    }
+
+    static uint64_t lower_bound(size_t i)
+    {
+        if (i < linear)
+            return i;
+
+        auto octave = (i - linear) / (1 << sub_bits) + 4;
+        auto sub    = (i - linear) % (1 << sub_bits);
+
+        return (uint64_t(1) << octave) + (uint64_t(sub) << (octave - sub_bits));
+    }
+
+    uint64_t count_[buckets];
+    uint64_t total_;
+    uint64_t max_;
+};
+
+
+// benchmark harness: workers run until stopped and measure the operations
+// and the time of the measurement phase, after the warm-up. The phases
+// are driven by the main thread (fixed duration) or by the operation count
+// of each worker (fixed iterations).
+//
+
+struct bench_control
+{
+    bench_control()
+    : phase(0)
+    , warmup_iterations(0)
+    , iterations(0)
+    {}
+
+    std::atomic<int> phase;                 // 0: warm-up, 1: measurement, 2: stop
+    unsigned long long warmup_iterations;
+    unsigned long long iterations;          // iteration-driven when not 0
+};
+
+bench_control control;
+
+
+struct bench_result
+{
+    bench_result()
+    : ops(0)
+    , seconds(0)
+    , latency(false)
+    {}
+
+    unsigned long long ops;
+    double seconds;
+
+    bool latency;                           // latency modes only
+    latency_histogram alloc_lat;
+    latency_histogram release_lat;
+};
+
+std::vector<bench_result> results;          // one per thread
+
+bool harness = false;
+
+
+struct bench_phase
+{
+    explicit bench_phase(int id)
+    : id_(static_cast<size_t>(id))
+    , phase_(0)
+    , started_(false)
+    , start_n_(0)
+    , start_()
+    {}
+
+    // invoked at every iteration with the operation count: false when the
+    // worker must stop
+    //
+
+    bool running(unsigned long long n)
+    {
+        int p = control.iterations ? (n < control.warmup_iterations ? 0 : n < control.warmup_iterations + control.iterations ? 1 : 2)
+                                   : control.phase.load(std::memory_order_relaxed);
+        started_ = false;
+
+        if (p == phase_)
+            return true;
+
+        auto now = std::chrono::steady_clock::now();
+
+        if (phase_ == 0)
+        {
+            started_ = true;
+            start_n_ = n;
+            start_   = now;
+        }
+
+        if (p == 2)
+        {
+            results[id_].ops     = n - start_n_;
+            results[id_].seconds = std::chrono::duration<double>(now - start_).count();
+        }
+
+        phase_ = p;
+        return p != 2;
+    }
+
+    // the measurement phase has just begun
+    //
+
+    bool started() const
+    {
+        return started_;
+    }
+
+private:
+    size_t id_;
+    int phase_;
+    bool started_;
+    unsigned long long start_n_;
+    std::chrono::steady_clock::time_point start_;
 };
 
 
@@ -125,19 +486,273 @@ struct worker
 
         Alloc allocator;
 
-        for(;;)
+        bench_phase phase(id);
+
+        while (phase.running(n))
+        {
+            if ((n % len) == 0) 
+            {
+                buffer.clear();
+            }
+
+            auto p = allocator();
+
+            buffer.push_back(std::move(p));
+
+            n++;
+
+            if ( (n & S) == 0 )
+            {
+                auto now = std::chrono::system_clock::now();
+                auto diff = now - last_tp;
+
+                counters[id].value = static_cast<int64_t>(n - last) * 1000000 / std::chrono::duration_cast<std::chrono::microseconds>(diff).count(); 
+
+                last_tp = now;
+                last    = n;
+            }
+        }
+    }
+};
+
+
+// burst worker thread: allocate slices in batches of burst_len
+//
+
+const size_t burst_len = 32;
+
+template <typename Policy>
+struct burst_worker
+{
+    void operator()(int id, size_t len)
+    {
+        typedef mem::policy_slice_allocator<Policy, 131072, target_type> allocator_type;
+
+        std::vector<decltype(std::declval<allocator_type &>().new_slices(burst_len, mem::none))> buffer;
+
+        buffer.reserve(len / burst_len + 1);
+
+        unsigned long long int n = 0, last = 0;
+
+        std::chrono::time_point<std::chrono::system_clock> last_tp;
+
+        auto S = (1ULL<<22) - 1;
+
+        allocator_type allocator;
+
+        bench_phase phase(id);
+
+        while (phase.running(n))
+        {
+            if ((n % len) < burst_len) 
+            {
+                buffer.clear();
+            }
+
+            buffer.push_back(allocator.new_slices(burst_len, mem::none));
+
+            n += burst_len;
+
+            if ( (n & S) < burst_len )
+            {
+                auto now = std::chrono::system_clock::now();
+                auto diff = now - last_tp;
+
+                counters[id].value = static_cast<int64_t>(n - last) * 1000000 / std::chrono::duration_cast<std::chrono::microseconds>(diff).count(); 
+
+                last_tp = now;
+                last    = n;
+            }
+        }
+    }
+};
+
+
+std::mutex report_mutex;
+
+
+// latency worker thread: time every allocation and every release. With
+// Rollover != 0 (slots per manager) the allocations that open a new
+// manager and the releases of the last slot of a manager are marked as
+// rollover events (with FIFO releases the latter is the one that
+// usually destroys the manager).
+//
+
+template <typename Tp, typename Alloc, size_t Rollover>
+struct latency_worker
+{
+    void operator()(int id, size_t len)
+    {
+        std::vector<Tp> buffer;
+
+        buffer.reserve(len);
+
+        latency_histogram alloc_lat, release_lat;
+        uint64_t rollovers = 0, rollover_max = 0, manager_end_max = 0;
+
+        unsigned long long int n = 0, r = 0, last = 0;
+
+        std::chrono::time_point<std::chrono::system_clock> last_tp;
+
+        auto S = (1ULL<<22) - 1;
+        auto ratio = ticks_per_ns();
+
+        Alloc allocator;
+
+        bench_phase phase(id);
+
+        while (phase.running(n))
         {
+            if (phase.started())
+            {
+                alloc_lat.clear();
+                release_lat.clear();
+            }
+
             if ((n % len) == 0) 
             {
+                for(auto &p : buffer)
+                {
+                    auto t0 = ticks();
+                    p = Tp();
+                    auto t1 = ticks();
+
+                    release_lat.add(t1 - t0);
+
+                    if (Rollover && (r++ % Rollover) == Rollover - 1)
+                        manager_end_max = std::max(manager_end_max, t1 - t0);
+                }
+
                 buffer.clear();
             }
 
+            auto t0 = ticks();
             auto p = allocator();
+            auto t1 = ticks();
+
+            alloc_lat.add(t1 - t0);
+
+            if (Rollover && n != 0 && (n % Rollover) == 0)
+            {
+                rollovers++;
+                rollover_max = std::max(rollover_max, t1 - t0);
+            }
 
             buffer.push_back(std::move(p));
 
             n++;
 
+            if ( (n & S) == 0 && !harness )
+            {
+                auto now = std::chrono::system_clock::now();
+                auto diff = now - last_tp;
+
+                counters[id].value = static_cast<int64_t>(n - last) * 1000000 / std::chrono::duration_cast<std::chrono::microseconds>(diff).count(); 
+
+                last_tp = now;
+                last    = n;
+
+                auto ns = [ratio](uint64_t v) { return static_cast<double>(v) / ratio; };
+
+                std::ostringstream out;
+
+                out << std::fixed << std::setprecision(1);
+                out << "thread " << id << " alloc   ns: p50 " << ns(alloc_lat.quantile(0.5)) << " p99 " << ns(alloc_lat.quantile(0.99))
+                    << " p99.9 " << ns(alloc_lat.quantile(0.999)) << " max " << ns(alloc_lat.max());
+                if (Rollover)
+                    out << " | rollovers " << rollovers << " max " << ns(rollover_max);
+                out << std::endl;
+
+                out << "thread " << id << " release ns: p50 " << ns(release_lat.quantile(0.5)) << " p99 " << ns(release_lat.quantile(0.99))
+                    << " p99.9 " << ns(release_lat.quantile(0.999)) << " max " << ns(release_lat.max());
+                if (Rollover)
+                    out << " | manager end max " << ns(manager_end_max);
+                out << std::endl;
+
+                {
+                    std::lock_guard<std::mutex> lock(report_mutex);
+                    std::cout << out.str();
+                }
+
+                alloc_lat.clear();
+                release_lat.clear();
+                rollovers = rollover_max = manager_end_max = 0;
+            }
+        }
+
+        auto &res = results[static_cast<size_t>(id)];
+        res.latency     = true;
+        res.alloc_lat   = alloc_lat;
+        res.release_lat = release_lat;
+    }
+};
+
+
+// producer/consumer: the producer thread allocates slices and hands them
+// to a consumer thread that drops them. With Remote, releases go back to
+// the producer through a remote_free_queue.
+//
+
+template <typename Policy, bool Remote>
+struct pipeline
+{
+    typedef mem::policy_slice_allocator<Policy, 131072, target_type> allocator_type;
+    typedef typename allocator_type::template pointer<mem::slice<target_type>> pointer_type;
+
+    void operator()(int id, size_t len)
+    {
+        mem::details::spsc_ring<pointer_type> channel(len);
+        mem::remote_free_queue remote(len);
+
+        std::atomic<bool> done(false);
+        std::atomic<bool> exited(false);
+
+        std::thread consumer([&]
+        {
+            pointer_type p;
+            for(;;)
+            {
+                if (!channel.pop(p)) {
+                    if (done.load())
+                        break;
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                (*mem::get<0>(p))[0]++;
+
+                drop(p, remote, std::integral_constant<bool, Remote>());
+            }
+
+            exited.store(true);
+        });
+
+        unsigned long long int n = 0, last = 0;
+
+        std::chrono::time_point<std::chrono::system_clock> last_tp;
+
+        auto S = (1ULL<<22) - 1;
+
+        allocator_type allocator;
+
+        bench_phase phase(id);
+
+        while (phase.running(n))
+        {
+            auto p = allocator.new_slice(mem::none);
+
+            while (!channel.push(std::move(p)))
+            {
+                if (Remote)
+                    remote.drain();
+                std::this_thread::yield();
+            }
+
+            n++;
+
+            if (Remote && (n & 63) == 0)
+                remote.drain();
+
             if ( (n & S) == 0 )
             {
                 auto now = std::chrono::system_clock::now();
@@ -149,50 +764,475 @@ struct worker
                 last    = n;
             }
         }
+
+        // the consumer may be blocked on a full remote queue: keep draining
+        // it until the consumer is gone
+
+        done.store(true);
+
+        while (!exited.load())
+        {
+            if (Remote)
+                remote.drain();
+            std::this_thread::yield();
+        }
+
+        consumer.join();
+
+        if (Remote)
+            remote.drain();
+    }
+
+    static void drop(pointer_type &p, mem::remote_free_queue &remote, std::true_type)
+    {
+        remote.push(std::move(p));
+    }
+
+    static void drop(pointer_type &p, mem::remote_free_queue &, std::false_type)
+    {
+        p.reset();
     }
 };
 
 
+// spawn the worker thread id of a mode
+//
+
+std::thread
+spawn(unsigned int mode, int id, size_t len)
+{
+    switch(mode)
+    {
+        case 0:
+            return std::thread(worker<std::unique_ptr<target_type>, raw_allocator>(), id, len);
+
+        case 1:
+            return std::thread(worker<std::shared_ptr<target_type>, shared_allocator>(), id, len);
+
+        case 2:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount>>(), id, len);
+
+        case 3:
+            return std::thread(worker<mem::local_ptr<mem::slice<target_type>>, mslice_allocator<mem::local_refcount>>(), id, len);
+
+        case 4:
+            return std::thread(worker<mem::local_unique_ptr<mem::slice<target_type>>, mslice_allocator<mem::unique_refcount>>(), id, len);
+
+        case 5:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount, mem::arena_backing::mmap>>(), id, len);
+
+        case 6:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount, mem::arena_backing::mmap, true>>(), id, len);
+
+        case 7:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount, mem::arena_backing::transparent>>(), id, len);
+
+        case 8:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount, mem::arena_backing::huge_2m, true>>(), id, len);
+
+        case 9:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount, mem::arena_backing::huge_1g, true>>(), id, len);
+
+        case 10:
+            return std::thread(burst_worker<mem::shared_refcount>(), id, len);
+
+        case 11:
+            return std::thread(burst_worker<mem::local_refcount>(), id, len);
+
+        case 12:
+            return std::thread(pipeline<mem::shared_refcount, false>(), id, len);
+
+        case 13:
+            return std::thread(pipeline<mem::local_refcount, true>(), id, len);
+
+        case 14:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, concurrent_mslice_allocator>(), id, len);
+
+        case 15:
+            return std::thread(worker<std::shared_ptr<mem::slice<mem::uninitialized<target_type>>>, construction_mslice_allocator<mem::uninitialized<target_type>>>(), id, len);
+
+        case 16:
+            return std::thread(worker<std::shared_ptr<mem::slice<mem::prototyped<target_type>>>, construction_mslice_allocator<mem::prototyped<target_type>>>(), id, len);
+
+        case 17:
+            return std::thread(worker<ref_mslice_allocator::pointer_type, ref_mslice_allocator>(), id, len);
+
+        case 18:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount, mem::arena_backing::mmap, false, mem::standby_mode::incremental>>(), id, len);
+
+        case 19:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount, mem::arena_backing::mmap, false, mem::standby_mode::thread>>(), id, len);
+
+        case 20:
+            return std::thread(latency_worker<std::unique_ptr<target_type>, raw_allocator, 0>(), id, len);
+
+        case 21:
+            return std::thread(latency_worker<std::shared_ptr<target_type>, shared_allocator, 0>(), id, len);
+
+        case 22:
+            return std::thread(latency_worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount>, 131072>(), id, len);
+
+        case 23:
+            return std::thread(latency_worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator<mem::shared_refcount, mem::arena_backing::mmap, false, mem::standby_mode::thread>, 131072>(), id, len);
+
+        case 24:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, dynamic_mslice_allocator<false>>(), id, len);
+
+        case 25:
+            return std::thread(worker<std::shared_ptr<mem::slice<target_type>>, dynamic_mslice_allocator<true>>(), id, len);
+
+        default:
+            throw std::runtime_error("mode not implemented");
+    }
+}
+
+
+const std::vector<const char *> mode_name = { "malloc", "malloc+shared_ptr", "slice_allocator",
+                                             "slice_allocator+local_refcount", "slice_allocator+unique_refcount",
+                                             "slice_allocator+mmap", "slice_allocator+mmap+prefault", "slice_allocator+transparent_hugepage",
+                                             "slice_allocator+hugetlb_2m+prefault", "slice_allocator+hugetlb_1g+prefault",
+                                             "slice_allocator+burst", "slice_allocator+local_refcount+burst",
+                                             "slice_allocator+producer/consumer", "slice_allocator+local_refcount+remote_free",
+                                             "concurrent_slice_allocator",
+                                             "slice_allocator+uninitialized", "slice_allocator+prototyped",
+                                             "slice_allocator+slice_ref",
+                                             "slice_allocator+mmap+standby_incremental", "slice_allocator+mmap+standby_thread",
+                                             "malloc+latency", "malloc+shared_ptr+latency", "slice_allocator+latency",
+                                             "slice_allocator+mmap+standby_thread+latency",
+                                             "dynamic_slice_allocator", "dynamic_slice_allocator+adaptive" };
+
+
+// harness options
+//
+
+struct bench_options
+{
+    bench_options()
+    : duration(0)
+    , warmup(1)
+    , iterations(0)
+    , warmup_iterations(0)
+    , reps(1)
+    , pin(false)
+    , format("json")
+    , baseline()
+    , threshold(0.05)
+    {}
+
+    double duration;                        // seconds of measurement
+    double warmup;                          // seconds of warm-up
+    unsigned long long iterations;          // operations per thread (instead of duration)
+    unsigned long long warmup_iterations;
+    unsigned int reps;
+    bool pin;                               // pin thread i to CPU i % #cpu
+    std::string format;                     // json or csv
+    std::string baseline;                   // json file of a previous run
+    double threshold;                       // tolerated regression (fraction)
+};
+
+
+struct bench_summary
+{
+    unsigned long long ops;
+    double seconds;
+    double mops;
+    bool latency;
+    double p50, p99, p999, max;             // allocation latency (ns)
+    double rel_p50, rel_p99, rel_p999, rel_max;     // release latency (ns)
+};
+
+
+inline void
+pin_thread(std::thread &t, unsigned int i)
+{
+    auto ncpu = std::max(1U, std::thread::hardware_concurrency());
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(i % ncpu, &set);
+
+    if (pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) != 0)
+        std::cerr << "warning: could not pin thread " << i << std::endl;
+}
+
+
+inline bench_summary
+run_once(unsigned int mode, unsigned int nthread, size_t len, bench_options const &opt)
+{
+    std::vector<std::thread> ws;
+
+    control.phase.store(0);
+    control.warmup_iterations = opt.warmup_iterations;
+    control.iterations        = opt.iterations;
+
+    results.assign(nthread, bench_result());
+
+    for(unsigned int i = 0; i < nthread; i++)
+    {
+        ws.push_back(spawn(mode, static_cast<int>(i), len));
+        if (opt.pin)
+            pin_thread(ws.back(), i);
+    }
+
+    if (opt.iterations == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(opt.warmup));
+        control.phase.store(1);
+        std::this_thread::sleep_for(std::chrono::duration<double>(opt.duration));
+        control.phase.store(2);
+    }
+
+    for(auto &t : ws)
+        t.join();
+
+    bench_summary ret = bench_summary();
+    latency_histogram lat, rel;
+
+    for(auto &r : results)
+    {
+        ret.ops     += r.ops;
+        ret.seconds  = std::max(ret.seconds, r.seconds);
+        ret.mops    += r.seconds > 0 ? static_cast<double>(r.ops) / r.seconds / 1000000 : 0;
+        ret.latency  = r.latency;
+        lat.merge(r.alloc_lat);
+        rel.merge(r.release_lat);
+    }
+
+    if (ret.latency)
+    {
+        auto ratio = ticks_per_ns();
+        ret.p50  = static_cast<double>(lat.quantile(0.5)) / ratio;
+        ret.p99  = static_cast<double>(lat.quantile(0.99)) / ratio;
+        ret.p999 = static_cast<double>(lat.quantile(0.999)) / ratio;
+        ret.max  = static_cast<double>(lat.max()) / ratio;
+
+        ret.rel_p50  = static_cast<double>(rel.quantile(0.5)) / ratio;
+        ret.rel_p99  = static_cast<double>(rel.quantile(0.99)) / ratio;
+        ret.rel_p999 = static_cast<double>(rel.quantile(0.999)) / ratio;
+        ret.rel_max  = static_cast<double>(rel.max()) / ratio;
+    }
+
+    return ret;
+}
+
+
+inline double
+median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    auto n = v.size();
+    return n % 2 ? v[n/2] : (v[n/2 - 1] + v[n/2]) / 2;
+}
+
+
+// value of a numeric field in a json document, -1 if missing
+//
+
+inline double
+json_number(std::string const &doc, std::string const &key)
+{
+    auto pos = doc.find("\"" + key + "\"");
+    if (pos == std::string::npos)
+        return -1;
+
+    pos = doc.find(':', pos);
+    if (pos == std::string::npos)
+        return -1;
+
+    return strtod(doc.c_str() + pos + 1, nullptr);
+}
+
+
+int
+run_harness(unsigned int mode, unsigned int nthread, size_t len, bench_options const &opt)
+{
+    std::vector<bench_summary> reps;
+
+    for(unsigned int r = 0; r < opt.reps; r++)
+        reps.push_back(run_once(mode, nthread, len, opt));
+
+    std::vector<double> mops, p99, rel_p99;
+    for(auto &r : reps)
+    {
+        mops.push_back(r.mops);
+        p99.push_back(r.p99);
+        rel_p99.push_back(r.rel_p99);
+    }
+
+    auto median_mops    = median(mops);
+    auto median_p99     = reps.front().latency ? median(p99) : -1;
+    auto median_rel_p99 = reps.front().latency ? median(rel_p99) : -1;
+
+    if (opt.format == "csv")
+    {
+        std::cout << "mode,threads,buff_len,rep,ops,seconds,mops,p50_ns,p99_ns,p999_ns,max_ns,"
+                     "release_p50_ns,release_p99_ns,release_p999_ns,release_max_ns" << std::endl;
+        for(size_t r = 0; r < reps.size(); r++)
+        {
+            auto &x = reps[r];
+            std::cout << mode_name[mode] << ',' << nthread << ',' << len << ',' << r << ',' << x.ops << ',' << x.seconds << ',' << x.mops;
+            if (x.latency)
+                std::cout << ',' << x.p50 << ',' << x.p99 << ',' << x.p999 << ',' << x.max
+                          << ',' << x.rel_p50 << ',' << x.rel_p99 << ',' << x.rel_p999 << ',' << x.rel_max << std::endl;
+            else
+                std::cout << ",,,,,,,," << std::endl;
+        }
+    }
+    else
+    {
+        std::cout << "{" << std::endl
+                  << "  \"mode\": \"" << mode_name[mode] << "\"," << std::endl
+                  << "  \"threads\": " << nthread << "," << std::endl
+                  << "  \"buff_len\": " << len << "," << std::endl
+                  << "  \"repetitions\": [" << std::endl;
+
+        for(size_t r = 0; r < reps.size(); r++)
+        {
+            auto &x = reps[r];
+            std::cout << "    { \"ops\": " << x.ops << ", \"seconds\": " << x.seconds << ", \"mops\": " << x.mops;
+            if (x.latency)
+                std::cout << ", \"p50_ns\": " << x.p50 << ", \"p99_ns\": " << x.p99 << ", \"p999_ns\": " << x.p999 << ", \"max_ns\": " << x.max
+                          << ", \"release_p50_ns\": " << x.rel_p50 << ", \"release_p99_ns\": " << x.rel_p99
+                          << ", \"release_p999_ns\": " << x.rel_p999 << ", \"release_max_ns\": " << x.rel_max;
+            std::cout << " }" << (r + 1 < reps.size() ? "," : "") << std::endl;
+        }
+
+        std::cout << "  ]," << std::endl;
+        if (median_p99 >= 0)
+            std::cout << "  \"median_p99_ns\": " << median_p99 << "," << std::endl
+                      << "  \"median_release_p99_ns\": " << median_rel_p99 << "," << std::endl;
+        std::cout << "  \"median_mops\": " << median_mops << std::endl
+                  << "}" << std::endl;
+    }
+
+    // compare against the baseline
+    //
+
+    if (opt.baseline.empty())
+        return 0;
+
+    std::ifstream in(opt.baseline);
+    if (!in)
+        throw std::runtime_error("cannot read baseline " + opt.baseline);
+
+    std::string doc((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    auto base_mops = json_number(doc, "median_mops");
+    auto base_p99  = json_number(doc, "median_p99_ns");
+    auto base_rel  = json_number(doc, "median_release_p99_ns");
+
+    int ret = 0;
+
+    if (base_mops > 0)
+    {
+        std::cerr << "throughput: " << median_mops << " Mops/sec, baseline " << base_mops << std::endl;
+        if (median_mops < base_mops * (1 - opt.threshold)) {
+            std::cerr << "regression: throughput below the baseline by more than " << opt.threshold * 100 << "%" << std::endl;
+            ret = 1;
+        }
+    }
+
+    if (base_p99 > 0 && median_p99 >= 0)
+    {
+        std::cerr << "p99: " << median_p99 << " ns, baseline " << base_p99 << std::endl;
+        if (median_p99 > base_p99 * (1 + opt.threshold)) {
+            std::cerr << "regression: p99 above the baseline by more than " << opt.threshold * 100 << "%" << std::endl;
+            ret = 1;
+        }
+    }
+
+    if (base_rel > 0 && median_rel_p99 >= 0)
+    {
+        std::cerr << "release p99: " << median_rel_p99 << " ns, baseline " << base_rel << std::endl;
+        if (median_rel_p99 > base_rel * (1 + opt.threshold)) {
+            std::cerr << "regression: release p99 above the baseline by more than " << opt.threshold * 100 << "%" << std::endl;
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
+
+
 int
 main(int argc, char *argv[])
 {
     std::vector<std::thread> ws;
 
     if (argc < 4)
-        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" mode #thread buff_len"));
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" mode #thread buff_len "
+                                 "[--duration sec | --iterations n] [--warmup sec | --warmup-iterations n] "
+                                 "[--reps n] [--pin] [--format json|csv] [--baseline file] [--threshold fraction]"));
 
     const auto mode    = static_cast<unsigned int>(atoi(argv[1]));
     const auto nthread = static_cast<unsigned int>(atoi(argv[2]));
     const auto buflen  = static_cast<unsigned int>(atoi(argv[3]));
 
-    for(unsigned int i = 0; i < nthread; i++)
+    if (mode >= mode_name.size())
+        throw std::runtime_error("mode not implemented");
+
+    // with a duration or an iteration count, run the harness
+    //
+
+    bench_options opt;
+
+    for(int i = 4; i < argc; i++)
     {
-        switch(mode)
-        {
-            case 0:
-            {
-                std::thread t(worker<std::unique_ptr<target_type>, raw_allocator>(), i, buflen); 
-                ws.push_back(std::move(t));
-            } break;
+        std::string arg = argv[i];
 
-            case 1:
-            {
-                std::thread t(worker<std::shared_ptr<target_type>, shared_allocator>(), i, buflen); 
-                ws.push_back(std::move(t));
-            } break;
+        auto value = [&]() -> const char *
+        {
+            if (i + 1 >= argc)
+                throw std::runtime_error("missing value for " + arg);
+            return argv[++i];
+        };
 
-            case 2:
-            {
-                std::thread t(worker<std::shared_ptr<mem::slice<target_type>>, mslice_allocator>(), i, buflen); 
-                ws.push_back(std::move(t));
-            } break;
+        if (arg == "--duration")
+            opt.duration = atof(value());
+        else if (arg == "--iterations")
+            opt.iterations = strtoull(value(), nullptr, 10);
+        else if (arg == "--warmup")
+            opt.warmup = atof(value());
+        else if (arg == "--warmup-iterations")
+            opt.warmup_iterations = strtoull(value(), nullptr, 10);
+        else if (arg == "--reps")
+            opt.reps = std::max(1U, static_cast<unsigned int>(atoi(value())));
+        else if (arg == "--pin")
+            opt.pin = true;
+        else if (arg == "--format")
+            opt.format = value();
+        else if (arg == "--baseline")
+            opt.baseline = value();
+        else if (arg == "--threshold")
+            opt.threshold = atof(value());
+        else
+            throw std::runtime_error("unknown option " + arg);
+    }
 
-            default:
-                throw std::runtime_error("mode not implemented");
-        }
+    if (opt.duration > 0 || opt.iterations > 0)
+    {
+        harness = true;
+        return run_harness(mode, nthread, buflen, opt);
     }
 
-    std::vector<const char *> mode_name = { "malloc", "malloc+shared_ptr", "slice_allocator" };
+    results.assign(nthread, bench_result());
+
+    for(unsigned int i = 0; i < nthread; i++)
+        ws.push_back(spawn(mode, static_cast<int>(i), buflen));
+
+    // huge page backings silently fall back to smaller pages: report what
+    // the system actually provides
+    //
+
+    if (mode >= 5 && mode <= 9)
+    {
+        const mem::arena_backing requested[] = { mem::arena_backing::mmap, mem::arena_backing::mmap, mem::arena_backing::transparent,
+                                                 mem::arena_backing::huge_2m, mem::arena_backing::huge_1g };
+        const char *backing_name[] = { "heap", "mmap", "transparent", "huge_2m", "huge_1g" };
+
+        mem::slice_allocator<target_type> probe(arena_options(requested[mode-5], false));
+        std::cout << "arena backing: " << backing_name[static_cast<int>(probe.backing())] << std::endl;
+    }
 
     for(;;) 
     {
@@ -209,8 +1249,5 @@ main(int argc, char *argv[])
                   << vt100::RESET << " Malloc/sec (million allocations per second)" << std::endl;
     }
 
-    ws[0].join();
-
     return 0;
 }
-